@@ -0,0 +1,505 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "libhw2.h"
+
+// Benchmarks for the codecs and operations behind hw2_main, driven through libhw2.
+// Image sizes run from 0.1 to 100 megapixels and palettes from 2 to 2^24 colours; the 100 MP cases
+// hold several encodings in memory at once, so select them with --benchmark_filter on small machines.
+// Codec benchmarks report bytes/s of encoded data and items/s in pixels.
+
+using namespace std;
+
+struct ImageDeleter {
+    void operator()(hw2_image *image) const { hw2_image_free(image); }
+};
+
+typedef unique_ptr<hw2_image, ImageDeleter> ImagePtr;
+
+struct FontDeleter {
+    void operator()(hw2_font *font) const { hw2_font_free(font); }
+};
+
+typedef unique_ptr<hw2_font, FontDeleter> FontPtr;
+
+static const int64_t kDeciMegapixels[] = {1, 10, 100, 1000};
+static const int64_t kPaletteSizes[] = {2, 256, 1 << 16, 1 << 24};
+static const int64_t kFontSizes[] = {1, 2, 4, 8, 16};
+
+static vector<int64_t> thread_counts() {
+    // 1, 2 and 4 threads, then one per online core, for the operations that split their work across threads.
+    vector<int64_t> counts = {1, 2, 4};
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 0 && cores != 1 && cores != 2 && cores != 4) {
+        counts.push_back(cores);
+    }
+    return counts;
+}
+
+static void image_dimensions(int64_t deciMegapixels, int *width, int *height) {
+    // 4:3 frames, so every size has realistic row lengths.
+    int64_t pixels = deciMegapixels * 100000;
+    int64_t w = 4;
+    while (w * w * 3 < pixels * 4) {
+        w++;
+    }
+    *width = (int) w;
+    *height = (int) ((pixels + w - 1) / w);
+}
+
+static vector<unsigned char> make_p6(int width, int height, int64_t colors) {
+    // Pixels come from `colors` distinct colours in runs of 1 to 16, like flat-shaded artwork.
+    // Multiplying by an odd constant permutes 24-bit values, so the first `colors` indices stay distinct.
+    char header[64];
+    int headerLength = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    vector<unsigned char> data(header, header + headerLength);
+    size_t pixels = (size_t) width * (size_t) height;
+    data.resize(data.size() + pixels * 3);
+    unsigned char *out = data.data() + headerLength;
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    size_t i = 0;
+    while (i < pixels) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t index = (uint32_t) (i < (size_t) colors ? i : (state >> 33) % (uint64_t) colors);
+        uint32_t rgb = (index * 0x9E3779u) & 0xFFFFFFu;
+        size_t run = 1 + (size_t) (state >> 59);
+        for (size_t k = 0; k < run && i < pixels; k++, i++) {
+            out[i * 3] = (unsigned char) (rgb >> 16);
+            out[i * 3 + 1] = (unsigned char) (rgb >> 8);
+            out[i * 3 + 2] = (unsigned char) rgb;
+        }
+    }
+    return data;
+}
+
+static const hw2_image *source_image(int64_t deciMegapixels, int64_t colors) {
+    static map<pair<int64_t, int64_t>, ImagePtr> cache;
+    ImagePtr &image = cache[make_pair(deciMegapixels, colors)];
+    if (!image) {
+        // Only one synthetic image is kept, so moving between the largest sizes does not exhaust memory.
+        cache.clear();
+        int width, height;
+        image_dimensions(deciMegapixels, &width, &height);
+        vector<unsigned char> p6 = make_p6(width, height, colors);
+        hw2_image *loaded = NULL;
+        if (hw2_image_load_memory(p6.data(), p6.size(), 0, &loaded) != 0) {
+            return NULL;
+        }
+        cache[make_pair(deciMegapixels, colors)].reset(loaded);
+        return loaded;
+    }
+    return image.get();
+}
+
+static vector<unsigned char> encode(const hw2_image *image, hw2_format format) {
+    void *data = NULL;
+    size_t size = 0;
+    vector<unsigned char> bytes;
+    if (hw2_image_save_memory(image, format, &data, &size) == 0) {
+        bytes.assign((unsigned char *) data, (unsigned char *) data + size);
+        free(data);
+    }
+    return bytes;
+}
+
+static bool working_copy(int64_t deciMegapixels, hw2_image **image) {
+    // Operations modify their image, so they get a private copy of the cached source.
+    const hw2_image *source = source_image(deciMegapixels, 256);
+    if (source == NULL) {
+        return false;
+    }
+    vector<unsigned char> p6 = encode(source, HW2_FORMAT_PPM_BINARY);
+    return hw2_image_load_memory(p6.data(), p6.size(), 0, image) == 0;
+}
+
+static int64_t pixel_count(const hw2_image *image) {
+    return (int64_t) hw2_image_width(image) * hw2_image_height(image);
+}
+
+static void codec_arguments(benchmark::internal::Benchmark *bench) {
+    // A palette larger than the image cannot be realised, so those pairs are skipped.
+    bench->ArgNames({"dMP", "colors"});
+    for (int64_t size : kDeciMegapixels) {
+        for (int64_t colors : kPaletteSizes) {
+            if (colors <= size * 100000) {
+                bench->Args({size, colors});
+            }
+        }
+    }
+    bench->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+static void BM_Load(benchmark::State &state, hw2_format format) {
+    const hw2_image *source = source_image(state.range(0), state.range(1));
+    if (source == NULL) {
+        state.SkipWithError("could not build the source image");
+        return;
+    }
+    vector<unsigned char> encoded = encode(source, format);
+    for (auto _ : state) {
+        hw2_image *image = NULL;
+        if (hw2_image_load_memory(encoded.data(), encoded.size(), 0, &image) != 0) {
+            state.SkipWithError("decode failed");
+            break;
+        }
+        benchmark::DoNotOptimize(image);
+        hw2_image_free(image);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) encoded.size());
+    state.SetItemsProcessed(state.iterations() * pixel_count(source));
+}
+
+static void BM_LoadP3Threads(benchmark::State &state) {
+    // The ASCII PPM body is split into chunks decoded in parallel, as hw2_main --threads does.
+    const hw2_image *source = source_image(state.range(0), 256);
+    if (source == NULL) {
+        state.SkipWithError("could not build the source image");
+        return;
+    }
+    vector<unsigned char> encoded = encode(source, HW2_FORMAT_PPM_ASCII);
+    int threads = (int) state.range(1);
+    for (auto _ : state) {
+        hw2_image *image = NULL;
+        if (hw2_image_load_memory(encoded.data(), encoded.size(), threads, &image) != 0) {
+            state.SkipWithError("decode failed");
+            break;
+        }
+        benchmark::DoNotOptimize(image);
+        hw2_image_free(image);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) encoded.size());
+    state.SetItemsProcessed(state.iterations() * pixel_count(source));
+}
+
+static void BM_Save(benchmark::State &state, hw2_format format) {
+    const hw2_image *source = source_image(state.range(0), state.range(1));
+    if (source == NULL) {
+        state.SkipWithError("could not build the source image");
+        return;
+    }
+    size_t encodedBytes = 0;
+    for (auto _ : state) {
+        void *data = NULL;
+        if (hw2_image_save_memory(source, format, &data, &encodedBytes) != 0) {
+            state.SkipWithError("encode failed");
+            break;
+        }
+        benchmark::DoNotOptimize(data);
+        free(data);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) encodedBytes);
+    state.SetItemsProcessed(state.iterations() * pixel_count(source));
+}
+
+static void BM_LoadPath(benchmark::State &state, hw2_format format) {
+    // Loading from a file takes the mmap path, which for P6 uses the mapping as the pixel buffer. Mapping alone
+    // reads no pixels, so every row is summed in the timed loop and the rates include faulting the file in.
+    const hw2_image *source = source_image(state.range(0), state.range(1));
+    if (source == NULL) {
+        state.SkipWithError("could not build the source image");
+        return;
+    }
+    vector<unsigned char> encoded = encode(source, format);
+    char path[] = "/tmp/bench_hw2_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1 || write(fd, encoded.data(), encoded.size()) != (ssize_t) encoded.size()) {
+        if (fd != -1) {
+            close(fd);
+            unlink(path);
+        }
+        state.SkipWithError("could not write the input file");
+        return;
+    }
+    close(fd);
+    for (auto _ : state) {
+        hw2_image *image = NULL;
+        if (hw2_image_load(path, 0, &image) != 0) {
+            state.SkipWithError("decode failed");
+            break;
+        }
+        size_t rowBytes = (size_t) hw2_image_width(image) * 3;
+        uint64_t sum = 0;
+        for (int row = 0; row < hw2_image_height(image); row++) {
+            const unsigned char *pixels = hw2_image_row(image, row);
+            for (size_t k = 0; k < rowBytes; k++) {
+                sum += pixels[k];
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+        hw2_image_free(image);
+    }
+    unlink(path);
+    state.SetBytesProcessed(state.iterations() * (int64_t) encoded.size());
+    state.SetItemsProcessed(state.iterations() * pixel_count(source));
+}
+
+BENCHMARK_CAPTURE(BM_Load, load_ppm_p3, HW2_FORMAT_PPM_ASCII)->Apply(codec_arguments);
+BENCHMARK_CAPTURE(BM_Load, load_ppm_p6, HW2_FORMAT_PPM_BINARY)->Apply(codec_arguments);
+BENCHMARK_CAPTURE(BM_Load, load_sbu_text, HW2_FORMAT_SBU)->Apply(codec_arguments);
+BENCHMARK_CAPTURE(BM_Load, load_sbu_binary, HW2_FORMAT_SBU_BINARY)->Apply(codec_arguments);
+BENCHMARK_CAPTURE(BM_LoadPath, load_ppm_p6_file, HW2_FORMAT_PPM_BINARY)->Apply(codec_arguments);
+BENCHMARK(BM_LoadP3Threads)->Apply([](benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"dMP", "threads"});
+    for (int64_t size : kDeciMegapixels) {
+        for (int64_t threads : thread_counts()) {
+            bench->Args({size, threads});
+        }
+    }
+})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Save, save_as_ppm_p3, HW2_FORMAT_PPM_ASCII)->Apply(codec_arguments);
+BENCHMARK_CAPTURE(BM_Save, save_as_ppm_p6, HW2_FORMAT_PPM_BINARY)->Apply(codec_arguments);
+BENCHMARK_CAPTURE(BM_Save, save_as_sbu_text, HW2_FORMAT_SBU)->Apply(codec_arguments);
+BENCHMARK_CAPTURE(BM_Save, save_as_sbu_binary, HW2_FORMAT_SBU_BINARY)->Apply(codec_arguments);
+
+static void BM_CopyPaste(benchmark::State &state) {
+    // A quarter of the frame is copied onto an overlapping region, the harder case for the row order.
+    hw2_image *image = NULL;
+    if (!working_copy(state.range(0), &image)) {
+        state.SkipWithError("could not build the source image");
+        return;
+    }
+    int width = hw2_image_width(image) / 2;
+    int height = hw2_image_height(image) / 2;
+    for (auto _ : state) {
+        hw2_copy_paste(image, 0, 0, width, height, height / 2, width / 2, 0);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) width * height * 3);
+    state.SetItemsProcessed(state.iterations() * (int64_t) width * height);
+    hw2_image_free(image);
+}
+
+BENCHMARK(BM_CopyPaste)->ArgName("dMP")->Arg(1)->Arg(10)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static void BM_CopyPasteDisjoint(benchmark::State &state) {
+    // The top-left quarter is pasted onto the bottom-right one; regions that do not overlap are split by rows
+    // across the given number of threads.
+    hw2_image *image = NULL;
+    if (!working_copy(state.range(0), &image)) {
+        state.SkipWithError("could not build the source image");
+        return;
+    }
+    int threads = (int) state.range(1);
+    int width = hw2_image_width(image) / 2;
+    int height = hw2_image_height(image) / 2;
+    for (auto _ : state) {
+        hw2_copy_paste(image, 0, 0, width, height, height, width, threads);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) width * height * 3);
+    state.SetItemsProcessed(state.iterations() * (int64_t) width * height);
+    hw2_image_free(image);
+}
+
+BENCHMARK(BM_CopyPasteDisjoint)->Apply([](benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"dMP", "threads"});
+    for (int64_t size : kDeciMegapixels) {
+        for (int64_t threads : thread_counts()) {
+            bench->Args({size, threads});
+        }
+    }
+})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static const int kWideFontGlyphs = 320;
+static const int kWideFontRows = 16;
+
+static string wide_font_path() {
+    // Font 6 is generated once: kWideFontGlyphs glyphs of 4 to 11 columns, named by a #!keys line that
+    // cycles through every printable byte, so it is as wide as a font with a full extended character set.
+    struct WideFont {
+        string path;
+        ~WideFont() {
+            if (!path.empty()) {
+                unlink(path.c_str());
+            }
+        }
+    };
+    static WideFont font;
+    if (!font.path.empty()) {
+        return font.path;
+    }
+    string keys;
+    for (int c = 33; c < 256; c++) {
+        if (c != 127) {
+            keys.push_back((char) c);
+        }
+    }
+    string text = "#!keys ";
+    vector<string> rows(kWideFontRows);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (int i = 0; i < kWideFontGlyphs; i++) {
+        text.push_back(keys[(size_t) i % keys.size()]);
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        int cols = 4 + (int) (state >> 61);
+        for (int j = 0; j < kWideFontRows; j++) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            for (int k = 0; k < cols; k++) {
+                // The outer columns are always inked, so segmentation finds exactly one glyph per key.
+                bool inked = k == 0 || k == cols - 1 || (state >> (20 + k)) & 1;
+                rows[(size_t) j].push_back(inked ? '*' : ' ');
+            }
+            rows[(size_t) j].push_back(' ');
+        }
+    }
+    text.push_back('\n');
+    for (const string &row : rows) {
+        text += row + "\n";
+    }
+    char path[] = "/tmp/bench_hw2_font_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        return "";
+    }
+    bool written = write(fd, text.data(), text.size()) == (ssize_t) text.size();
+    close(fd);
+    font.path = path;
+    return written ? font.path : "";
+}
+
+static void BM_FontLoad(benchmark::State &state) {
+    // Parsing a text font and building its glyph runs, metrics and index. Bytes are the font file's.
+    string path = state.range(0) == 6 ? wide_font_path()
+                                      : string(HW2_SOURCE_DIR "/tests/fonts/font") + to_string(state.range(0)) + ".txt";
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        state.SkipWithError("font missing");
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    int64_t fileBytes = ftell(file);
+    fclose(file);
+    for (auto _ : state) {
+        hw2_font *font = NULL;
+        if (hw2_font_load(path.c_str(), &font) != 0) {
+            state.SkipWithError("font missing");
+            break;
+        }
+        benchmark::DoNotOptimize(font);
+        hw2_font_free(font);
+    }
+    state.SetBytesProcessed(state.iterations() * fileBytes);
+}
+
+BENCHMARK(BM_FontLoad)->ArgName("font")->DenseRange(1, 6)->Unit(benchmark::kMicrosecond);
+
+// A 215-character message on five lines; -r draws one line, so each line is rendered below the last.
+static const char *const kMessageLines[] = {
+    "THE SEAWOLVES OF STONY BROOK TAKE THE FIELD",
+    "AT KENNETH P LAVALLE STADIUM ON A COLD NIGHT",
+    "AND THE CROWD IN RED AND GREY STANDS TO CHEER",
+    "AS THE BAND PLAYS THE FIGHT SONG ONCE AGAIN",
+    "GO SEAWOLVES GO STONY BROOK WIN THIS ONE",
+};
+
+static int render_lines(hw2_image *image, const hw2_font *font, int size, int threads) {
+    int row = 10;
+    for (const char *line : kMessageLines) {
+        int result = hw2_render(image, font, line, size, row, 10, threads);
+        if (result != 0) {
+            return result;
+        }
+        row += (hw2_font_height(font) + 1) * size;
+    }
+    return 0;
+}
+
+static int64_t covered_pixels(const hw2_font *font, int size, int width, int height) {
+    // Drawn once on a black frame, the white pixels are exactly the ones the message covers.
+    vector<unsigned char> p6 = make_p6(width, height, 1);
+    hw2_image *blank = NULL;
+    if (hw2_image_load_memory(p6.data(), p6.size(), 1, &blank) != 0) {
+        return 0;
+    }
+    ImagePtr image(blank);
+    int64_t covered = 0;
+    if (render_lines(blank, font, size, 1) == 0) {
+        for (int row = 0; row < height; row++) {
+            const unsigned char *pixels = hw2_image_row(blank, row);
+            for (int col = 0; col < width * 3; col += 3) {
+                covered += pixels[col] == 255 && pixels[col + 1] == 255 && pixels[col + 2] == 255;
+            }
+        }
+    }
+    return covered;
+}
+
+static void BM_PrintMessage(benchmark::State &state) {
+    // Glyphs are scaled while they are drawn, so this covers the glyph cache and layout as well as the blit.
+    // Items are the pixels the message covers, and bytes are those pixels' RGB bytes.
+    hw2_image *image = NULL;
+    hw2_font *loaded = NULL;
+    if (!working_copy(100, &image) || hw2_font_load(HW2_SOURCE_DIR "/tests/fonts/font1.txt", &loaded) != 0) {
+        hw2_image_free(image);
+        state.SkipWithError("could not build the inputs");
+        return;
+    }
+    FontPtr font(loaded);
+    int size = (int) state.range(0);
+    int64_t covered = covered_pixels(font.get(), size, hw2_image_width(image), hw2_image_height(image));
+    for (auto _ : state) {
+        if (render_lines(image, font.get(), size, 0) != 0) {
+            state.SkipWithError("render failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * covered);
+    state.SetBytesProcessed(state.iterations() * covered * 3);
+    hw2_image_free(image);
+}
+
+BENCHMARK(BM_PrintMessage)->ArgName("size")->Apply([](benchmark::internal::Benchmark *bench) {
+    for (int64_t size : kFontSizes) {
+        bench->Arg(size);
+    }
+})->Unit(benchmark::kMicrosecond);
+
+static void BM_PrintMessageCold(benchmark::State &state) {
+    // The font is reloaded outside the timed region before every render, so each iteration scales every
+    // glyph of the message from an empty cache. Items and bytes are counted as in BM_PrintMessage.
+    hw2_image *image = NULL;
+    hw2_font *loaded = NULL;
+    const char *fontPath = HW2_SOURCE_DIR "/tests/fonts/font1.txt";
+    if (!working_copy(100, &image) || hw2_font_load(fontPath, &loaded) != 0) {
+        hw2_image_free(image);
+        state.SkipWithError("could not build the inputs");
+        return;
+    }
+    int size = (int) state.range(0);
+    int64_t covered = covered_pixels(loaded, size, hw2_image_width(image), hw2_image_height(image));
+    hw2_font_free(loaded);
+    for (auto _ : state) {
+        state.PauseTiming();
+        hw2_font *font = NULL;
+        if (hw2_font_load(fontPath, &font) != 0) {
+            state.SkipWithError("font missing");
+            break;
+        }
+        state.ResumeTiming();
+        int result = render_lines(image, font, size, 0);
+        state.PauseTiming();
+        hw2_font_free(font);
+        state.ResumeTiming();
+        if (result != 0) {
+            state.SkipWithError("render failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * covered);
+    state.SetBytesProcessed(state.iterations() * covered * 3);
+    hw2_image_free(image);
+}
+
+BENCHMARK(BM_PrintMessageCold)->ArgName("size")->Apply([](benchmark::internal::Benchmark *bench) {
+    for (int64_t size : kFontSizes) {
+        bench->Arg(size);
+    }
+})->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * Load driver for hw2_main --serve. Each of CONNECTIONS threads sends REQUESTS copies of one job and
+ * times every round trip; the report gives latency percentiles over all of them and the overall rate.
+ *
+ *   serve_load [-c CONNECTIONS] [-n REQUESTS] [-r] SOCKET JOB ARGS...
+ *
+ * -r opens a new connection for every request, as hw2_main --client does.
+ */
+
+
+typedef struct LoadWorker {
+	const char *socketPath;
+	const char *request;
+	int requests;
+	bool reconnect;
+	double *latencies;
+	int failures;
+} LoadWorker;
+
+
+void *load_worker(void *arg);
+
+
+int connect_server(const char *socketPath);
+
+
+bool round_trip(int fd, const char *request, int *code);
+
+
+double now_ms(void);
+
+
+int compare_doubles(const void *a, const void *b);
+
+
+char *join_request(int argc, char **argv);
+
+
+int main(int argc, char **argv) {
+	int connections = 1;
+	int requests = 200;
+	bool reconnect = false;
+	int o;
+	while ((o = getopt(argc, argv, "+c:n:r")) != -1) {
+		switch (o) {
+			case 'c':
+				connections = atoi(optarg);
+				break;
+			case 'n':
+				requests = atoi(optarg);
+				break;
+			case 'r':
+				reconnect = true;
+				break;
+			default:
+				return 2;
+		}
+	}
+	if (argc - optind < 2 || connections <= 0 || requests <= 0) {
+		fprintf(stderr, "usage: %s [-c CONNECTIONS] [-n REQUESTS] [-r] SOCKET JOB ARGS...\n", argv[0]);
+		return 2;
+	}
+	const char *socketPath = argv[optind];
+	char *request = join_request(argc - optind - 1, argv + optind + 1);
+	LoadWorker *workers = calloc((size_t) connections, sizeof(LoadWorker));
+	pthread_t *threads = calloc((size_t) connections, sizeof(pthread_t));
+	double *latencies = calloc((size_t) connections * (size_t) requests, sizeof(double));
+	if (request == NULL || workers == NULL || threads == NULL || latencies == NULL) {
+		return 1;
+	}
+
+	double start = now_ms();
+	for (int i = 0; i < connections; i++) {
+		workers[i] = (LoadWorker) {socketPath, request, requests, reconnect, latencies + (size_t) i * requests, 0};
+		pthread_create(&threads[i], NULL, load_worker, &workers[i]);
+	}
+	int failures = 0;
+	for (int i = 0; i < connections; i++) {
+		pthread_join(threads[i], NULL);
+		failures += workers[i].failures;
+	}
+	double elapsed = now_ms() - start;
+
+	size_t total = (size_t) connections * (size_t) requests;
+	qsort(latencies, total, sizeof(double), compare_doubles);
+	printf("%zu requests over %d connection%s%s, %d failed\n", total, connections, connections == 1 ? "" : "s",
+		   reconnect ? " (reconnecting)" : "", failures);
+	printf("p50 %.2f ms  p90 %.2f ms  p99 %.2f ms  max %.2f ms\n", latencies[total / 2],
+		   latencies[total * 9 / 10], latencies[total * 99 / 100], latencies[total - 1]);
+	printf("%.0f requests/s\n", (double) total * 1000.0 / elapsed);
+	free(latencies);
+	free(threads);
+	free(workers);
+	free(request);
+	return failures > 0 ? 1 : 0;
+}
+
+void *load_worker(void *arg) {
+	LoadWorker *worker = arg;
+	int fd = -1;
+	for (int i = 0; i < worker->requests; i++) {
+		double start = now_ms();
+		if (fd == -1) {
+			fd = connect_server(worker->socketPath);
+		}
+		int code = -1;
+		if (fd == -1 || !round_trip(fd, worker->request, &code) || code != 0) {
+			worker->failures++;
+		}
+		if (worker->reconnect && fd != -1) {
+			close(fd);
+			fd = -1;
+		}
+		worker->latencies[i] = now_ms() - start;
+	}
+	if (fd != -1) {
+		close(fd);
+	}
+	return NULL;
+}
+
+int connect_server(const char *socketPath) {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		return -1;
+	}
+	strcpy(address.sun_path, socketPath);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd != -1 && connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+bool round_trip(int fd, const char *request, int *code) {
+	size_t length = strlen(request);
+	if (send(fd, request, length, MSG_NOSIGNAL) != (ssize_t) length) {
+		return false;
+	}
+	char reply[16] = {0};
+	size_t received = 0;
+	while (received < sizeof(reply) - 1) {
+		ssize_t count = read(fd, reply + received, sizeof(reply) - 1 - received);
+		if (count <= 0) {
+			return false;
+		}
+		received += (size_t) count;
+		if (reply[received - 1] == '\n') {
+			*code = atoi(reply);
+			return true;
+		}
+	}
+	return false;
+}
+
+double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1e6;
+}
+
+int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+char *join_request(int argc, char **argv) {
+	// Same line format as hw2_main --client: words with blanks are quoted, and the line ends in a newline.
+	size_t length = 2;
+	for (int i = 0; i < argc; i++) {
+		length += strlen(argv[i]) + 3;
+	}
+	char *request = malloc(length);
+	if (request == NULL) {
+		return NULL;
+	}
+	char *end = request;
+	for (int i = 0; i < argc; i++) {
+		bool quote = strpbrk(argv[i], " \t") != NULL;
+		end += sprintf(end, quote ? "%s\"%s\"" : "%s%s", i > 0 ? " " : "", argv[i]);
+	}
+	strcpy(end, "\n");
+	return request;
+}
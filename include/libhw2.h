@@ -0,0 +1,82 @@
+#ifndef LIBHW2_H
+#define LIBHW2_H
+
+#include <stddef.h>
+
+#include "hw2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define HW2_API __attribute__((visibility("default")))
+#else
+#define HW2_API
+#endif
+
+/*
+ * In-process interface to the hw2 image tools. Every function that can fail returns 0 or one of the
+ * error codes from hw2.h; none of them exit the process. A `threads` argument of 0 uses one thread per
+ * online core.
+ */
+
+typedef struct hw2_image hw2_image;
+typedef struct hw2_font hw2_font;
+
+typedef enum hw2_format {
+	HW2_FORMAT_AUTO,        /* saving to a path: chosen by its extension (.ppm is P3, .sbu is text SBU) */
+	HW2_FORMAT_PPM_ASCII,
+	HW2_FORMAT_PPM_BINARY,
+	HW2_FORMAT_SBU,
+	HW2_FORMAT_SBU_BINARY
+} hw2_format;
+
+/* Loads a PPM (P3/P6) or SBU image, detected from its magic bytes. "-" reads stdin. */
+HW2_API int hw2_image_load(const char *path, int threads, hw2_image **image);
+
+/* Same as hw2_image_load for an encoded image already in memory; the buffer is not retained. */
+HW2_API int hw2_image_load_memory(const void *data, size_t size, int threads, hw2_image **image);
+
+/* Writes the image to a path; "-" writes stdout. A format outside hw2_format fails with UNRECOGNIZED_ARGUMENT. */
+HW2_API int hw2_image_save(const hw2_image *image, const char *path, hw2_format format);
+
+/* Encodes the image into a new buffer returned in *data, which the caller releases with free(). The format
+ * must be given; HW2_FORMAT_AUTO fails with UNRECOGNIZED_ARGUMENT. */
+HW2_API int hw2_image_save_memory(const hw2_image *image, hw2_format format, void **data, size_t *size);
+
+HW2_API void hw2_image_free(hw2_image *image);
+
+HW2_API int hw2_image_width(const hw2_image *image);
+
+HW2_API int hw2_image_height(const hw2_image *image);
+
+/* Row `row` as width * 3 bytes of R, G, B, or NULL when the row is out of range. */
+HW2_API const unsigned char *hw2_image_row(const hw2_image *image, int row);
+
+/* Copies the width x height region at (row, col) to (pasteRow, pasteCol), clipped like -c/-p. */
+HW2_API int hw2_copy_paste(hw2_image *image, int row, int col, int width, int height, int pasteRow, int pasteCol,
+						   int threads);
+
+/* Loads a text or compiled (--compile-font) font. */
+HW2_API int hw2_font_load(const char *path, hw2_font **font);
+
+HW2_API void hw2_font_free(hw2_font *font);
+
+/* Rows of the font's glyphs at size 1; a message drawn at size s is at most s times this tall. */
+HW2_API int hw2_font_height(const hw2_font *font);
+
+/* Draws `message` like -r; fails with MISSING_ARGUMENT if the font lacks one of its characters. */
+HW2_API int hw2_render(hw2_image *image, const hw2_font *font, const char *message, int size, int row, int col,
+					   int threads);
+
+/* Runs one hw2_main command line (argv[0] is ignored) and returns its exit code. It parses with getopt,
+ * so calls must not overlap across threads. Like the program it uses the process's standard streams: "-"
+ * paths read stdin or write stdout, --batch prints its report to stdout, and diagnostics go to stderr. */
+HW2_API int hw2_run(int argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,4360 @@
+#include "hw2.h"
+#include "libhw2.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <strings.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define PIXEL_ROW_ALIGNMENT 64
+#define HUGE_PAGE_SIZE (2u * 1024u * 1024u)
+#define OUTPUT_BUFFER_SIZE (1u << 20)
+#define SBU_BINARY_MAGIC "SBUB"
+#define READER_RELEASE_STEP (1u << 20)
+#define PARALLEL_MIN_BYTES (1u << 18)
+#define MAX_THREADS 256
+#define FONT_MAGIC "HW2F"
+#define FONT_VERSION 2
+#define FONT_KEYS_PREFIX "#!keys"
+#define FONT_SCALED_SIZES 32
+#define FONT_MAX_GLYPH_SIZE 4096
+#define FONT_CACHE_MAX 16
+#define SCRATCH_MAX_BYTES (64u * 1024u * 1024u)
+
+
+typedef struct Pixel {
+	unsigned char r, g, b;
+} Pixel;
+
+_Static_assert(sizeof(Pixel) == 3, "Pixel rows are read and written as packed RGB bytes");
+
+
+typedef struct Image {
+	int width, height;
+	size_t stride;	// a multiple of PIXEL_ROW_ALIGNMENT, except for zero-copy P6 images where it is the width
+	Pixel *pixels;
+	size_t capacity;
+	void *mapping;
+	size_t mappingSize;
+} Image;
+
+
+typedef struct ImageView {
+	int width, height;
+	size_t stride;
+	Pixel *pixels;
+} ImageView;
+
+
+typedef struct FileData {
+	const unsigned char *data;
+	size_t size;
+	void *mapping;
+} FileData;
+
+
+typedef struct Scanner {
+	const unsigned char *pos;
+	const unsigned char *end;
+} Scanner;
+
+
+typedef struct OutputBuffer {
+	int fd;
+	unsigned char *data;
+	size_t length;
+	size_t capacity;
+	bool failed;
+} OutputBuffer;
+
+
+typedef struct DigitTable {
+	unsigned char text[256][4];
+	unsigned char length[256];
+} DigitTable;
+
+
+typedef struct Palette {
+	Pixel *colors;
+	int count;
+	int capacity;
+	uint64_t *slots;
+	size_t mask;
+} Palette;
+
+
+typedef struct PixelCursor {
+	Image *img;
+	int row, col;
+} PixelCursor;
+
+
+typedef enum ImageFormat {
+	FORMAT_NONE,
+	FORMAT_PPM_ASCII,
+	FORMAT_PPM_BINARY,
+	FORMAT_SBU,
+	FORMAT_SBU_BINARY
+} ImageFormat;
+
+
+typedef struct RowReader {
+	FileData file;
+	Scanner scanner;
+	ImageFormat format;
+	int width, height;
+	int nextRow;
+	unsigned maxval;
+	const unsigned char *body;
+	const Pixel *palette;
+	Pixel *ownedPalette;
+	uint32_t numColors;
+	int indexBytes;
+	uint64_t pixelsLeft;
+	uint64_t pendingRun;
+	Pixel pendingColor;
+	bool dropConsumed;
+	size_t released;
+	bool failed;
+} RowReader;
+
+
+typedef struct RowWriter {
+	OutputBuffer out;
+	ImageFormat format;
+	DigitTable table;
+	const Palette *palette;
+	int indexBytes;
+	uint64_t runLength;
+	Pixel current;
+} RowWriter;
+
+
+typedef struct SaveParams {
+	bool binaryPpm;
+	bool binarySbu;
+	const char *type;
+} SaveParams;
+
+
+typedef struct LoadParams {
+	int threads;
+} LoadParams;
+
+
+typedef struct SampleChunk {
+	const unsigned char *begin, *end;
+	Image *img;
+	unsigned maxval;
+	uint64_t count;
+	uint64_t first;
+	uint64_t limit;
+	bool stopped;
+} SampleChunk;
+
+
+typedef struct CopyParams {
+	int row, column, width, height;
+} CopyParams;
+
+
+typedef struct RowCopy {
+	ImageView src, dst;
+	int firstRow, lastRow;
+	bool bottomUp;
+} RowCopy;
+
+
+typedef struct PasteParams {
+	int row, column;
+} PasteParams;
+
+
+typedef struct RenderParams {
+	char *message;
+	char *fontPath;
+	int fontSize;
+	int row;
+	int col;
+} RenderParams;
+
+
+enum LongOption {
+	OPT_PPM_FORMAT = 256,
+	OPT_SBU_FORMAT,
+	OPT_FORMAT,
+	OPT_MAX_MEMORY,
+	OPT_THREADS,
+	OPT_COMPILE_FONT,
+	OPT_BATCH,
+	OPT_SERVE,
+	OPT_CLIENT
+};
+
+
+typedef enum ScriptOpType {
+	OP_COPY,
+	OP_PASTE,
+	OP_RENDER
+} ScriptOpType;
+
+
+typedef struct ScriptOp {
+	ScriptOpType type;
+	CopyParams copy;
+	PasteParams paste;
+	RenderParams render;
+	char **args;
+} ScriptOp;
+
+
+typedef struct Script {
+	ScriptOp *ops;
+	int count;
+	int capacity;
+} Script;
+
+
+typedef struct GlyphRun {
+	int start, length;
+} GlyphRun;
+
+
+typedef struct GlyphMetrics {
+	int inkTop, inkBottom;
+	int inkLeft, inkRight;
+	int advance;
+} GlyphMetrics;
+
+
+typedef struct FontChar {
+	char key; 
+	const uint64_t *bits;
+	int wordsPerRow;
+	GlyphRun *runs;
+	int *rowRuns;
+	GlyphMetrics metrics;
+	int rows; 
+	int cols;
+} FontChar;
+
+
+typedef struct ScaledGlyph {
+	GlyphRun *runs;
+	int *lineRows;
+	int top, bottom;
+} ScaledGlyph;
+
+
+typedef struct ScaledGlyphs {
+	int size;
+	ScaledGlyph **glyphs;
+} ScaledGlyphs;
+
+
+typedef struct Font {
+	FontChar *characters;   
+	int numChars; 
+	FileData file;
+	FontChar *index[256];
+	ScaledGlyphs scaled[FONT_SCALED_SIZES];
+	int numScaled;
+	pthread_mutex_t scaledLock;
+	int users;	// font caches holding the font; it is freed when the last one lets go
+} Font;
+
+
+typedef struct GlyphPlacement {
+	const FontChar *glyph;
+	const ScaledGlyph *scaled;
+	int col;
+} GlyphPlacement;
+
+
+typedef struct MessageLayout {
+	GlyphPlacement *glyphs;
+	int count;
+	ScaledGlyph **owned;
+	int numOwned;
+	int row;
+	int size;
+	int top, bottom;
+	uint64_t inkBytes;
+} MessageLayout;
+
+
+typedef struct RasterTask {
+	const MessageLayout *layout;
+	Image *band;
+	int firstRow;
+	int from, to;
+} RasterTask;
+
+
+typedef struct FontFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t numGlyphs;
+	uint32_t rows;
+} FontFileHeader;
+
+
+typedef struct FontGlyphEntry {
+	uint32_t key;
+	uint32_t cols;
+	uint32_t numRuns;
+	int32_t inkTop, inkBottom;
+	int32_t inkLeft, inkRight;
+	uint32_t reserved;
+	uint64_t offset;	// rows + 1 int32 run indices, then numRuns GlyphRuns, padded to 8 bytes
+} FontGlyphEntry;
+
+_Static_assert(sizeof(FontFileHeader) == 16 && sizeof(FontGlyphEntry) == 40 && sizeof(GlyphRun) == 8,
+			   "Compiled glyph runs are 8-byte aligned after the header and directory");
+
+
+typedef struct FontCacheEntry {
+	char *path;
+	dev_t device;
+	ino_t inode;
+	struct timespec modified;
+	Font *font;
+} FontCacheEntry;
+
+
+typedef struct FontCache {
+	FontCacheEntry *entries;	// least recently used first when the cache has a limit
+	int count;
+	int capacity;
+	int limit;	// fonts kept, each checked against its file on use; 0 keeps every font as first loaded
+	pthread_mutex_t *lock;	// taken to release fonts shared with another cache, or NULL if the caller holds it
+} FontCache;
+
+
+typedef struct Job {
+	char *inputPath;
+	char *outputPath;
+	bool pasting;
+	CopyParams copy;
+	PasteParams paste;
+	RenderParams render;
+	char **renderArgs;
+	Script script;
+	SaveParams save;
+	LoadParams load;
+	uint64_t maxMemory;
+	char *compileFontPath;
+	char *batchPath;
+	char *servePath;
+	char *clientPath;
+	int clientArgc;
+	char **clientArgv;
+} Job;
+
+
+typedef struct BatchJob {
+	char *line;
+	char **argv;
+	int lineNumber;
+	Job job;
+	int result;
+} BatchJob;
+
+
+typedef struct Batch {
+	BatchJob *jobs;
+	int count;
+	int capacity;
+	int next;
+	pthread_mutex_t lock;
+	FontCache fonts;
+} Batch;
+
+
+typedef struct BatchWorker {
+	Batch *batch;
+} BatchWorker;
+
+
+typedef struct Scratch {
+	void *pixels;
+	size_t pixelBytes;
+	unsigned char *output;
+} Scratch;
+
+
+static _Thread_local Scratch *workerScratch;
+
+
+typedef struct ServeWorker ServeWorker;
+
+
+typedef struct Server {
+	int fd;
+	pthread_mutex_t lock;
+	bool stopping;
+	FontCache fonts;
+	ServeWorker *workers;
+	int numWorkers;
+} Server;
+
+
+struct ServeWorker {
+	Server *server;
+	int client;
+};
+
+
+struct hw2_image {
+	Image image;
+	struct stat source;	// the file a zero-copy image is mapped from, valid while image.mapping is set
+};
+
+
+struct hw2_font {
+	Font *font;
+};
+
+
+static bool charIn(int option, const char *string);
+
+
+
+static bool startWith(const char *filename, const char *string);
+
+
+static bool checkCopyParams(char *params);
+
+
+static char **split(const char *str, const char *delim);
+
+
+static int count_words(const char *str, const char *delim, int numwords);
+
+
+static int arrayLength(char **pString);
+
+
+static void freeArr(char **pString);
+
+
+static bool checkPasteParams(char *params);
+
+
+static bool checkRenderParams(char *params);
+
+
+static const char *getExt(const char *filename);
+
+
+static bool map_file(const char *filepath, FileData *file);
+
+
+static bool map_descriptor(int fd, FileData *file);
+
+
+static bool parse_ppm_header(Scanner *scanner, unsigned *width, unsigned *height, unsigned *maxval, bool *binary);
+
+
+static void unmap_file(FileData *file);
+
+
+static void scanner_skip_space(Scanner *scanner);
+
+
+static bool scan_u64(Scanner *scanner, uint64_t *value);
+
+
+static bool scan_uint(Scanner *scanner, unsigned *value);
+
+
+static bool scan_word(Scanner *scanner, const char *word);
+
+
+static unsigned char scale_sample(unsigned value, unsigned maxval);
+
+
+static unsigned char *scan_samples(Scanner *scanner, unsigned char *out, unsigned char *outEnd, unsigned maxval);
+
+
+static bool load_image(const char *filepath, LoadParams params, Image *img);
+
+static bool decode_image(RowReader *reader, LoadParams params, Image *img);
+
+
+static Image load_ppm_reader(RowReader *reader, LoadParams params);
+
+
+static bool load_ppm_parallel(RowReader *reader, Image *img, int threads);
+
+
+static int parse_threads(const char *text);
+
+
+static uint64_t count_samples(const unsigned char *p, const unsigned char *end, bool *stopped);
+
+
+static void *count_chunk(void *arg);
+
+
+static void *decode_chunk(void *arg);
+
+
+static bool run_parallel(void *tasks, size_t taskSize, int count, void *(*worker)(void *));
+
+
+static void *copy_rows(void *arg);
+
+
+static Image load_sbu_reader(RowReader *reader);
+
+
+static ImageFormat output_format(const char *filepath, SaveParams params);
+
+
+static bool save_with_format(const Image *img, const char *filepath, ImageFormat format);
+
+
+static bool encode_image(const Image *img, const char *filepath, ImageFormat format, OutputBuffer *memory);
+
+
+static bool output_writable(const char *filepath);
+
+
+static bool same_file(const char *input, const char *output);
+
+static bool input_stat(const char *filepath, struct stat *st);
+
+
+static bool reader_open(RowReader *reader, const char *filepath);
+
+
+static bool reader_open_memory(RowReader *reader, const void *data, size_t size);
+
+
+static bool reader_parse(RowReader *reader);
+
+
+static void reader_rewind(RowReader *reader);
+
+
+static bool reader_read_rows(RowReader *reader, Image *band, int rows);
+
+
+static bool reader_next_run(RowReader *reader);
+
+
+static void reader_release(RowReader *reader);
+
+
+static bool reader_finish(RowReader *reader);
+
+
+static void reader_close(RowReader *reader);
+
+
+static bool writer_open(RowWriter *writer, const char *filepath, ImageFormat format, int width, int height,
+				 const Palette *palette);
+
+
+static bool writer_begin(RowWriter *writer, ImageFormat format, int width, int height, const Palette *palette);
+
+
+static void writer_write_rows(RowWriter *writer, const Image *band, int rows);
+
+
+static bool writer_close(RowWriter *writer);
+
+
+static bool parse_size(const char *text, uint64_t *bytes);
+
+
+static int stream_image(const char *inputPath, const char *outputPath, ImageFormat format, const CopyParams *copy,
+				 const PasteParams *paste, const RenderParams *render, uint64_t maxMemory);
+
+
+static void fill_pixels(Pixel *dst, Pixel color, size_t count);
+
+
+static bool cursor_fill(PixelCursor *cursor, Pixel color, uint64_t count);
+
+
+static bool output_open(OutputBuffer *out, const char *filepath);
+
+
+static bool output_open_memory(OutputBuffer *out);
+
+
+static void output_flush(OutputBuffer *out);
+
+
+static void output_write(OutputBuffer *out, const void *data, size_t length);
+
+
+static bool output_close(OutputBuffer *out);
+
+
+static void build_digit_table(DigitTable *table);
+
+
+static void output_uint(OutputBuffer *out, uint64_t value, char suffix);
+
+
+static void emit_sbu_run(OutputBuffer *out, uint64_t runLength, int index, int indexBytes);
+
+
+static void output_varint(OutputBuffer *out, uint64_t value);
+
+
+static bool read_varint(Scanner *scanner, uint64_t *value);
+
+
+static int sbu_index_bytes(int numColors);
+
+
+static bool build_palette(const Image *img, Palette *palette);
+
+
+static bool palette_add_image(Palette *palette, const Image *img);
+
+
+static Image empty_image(void);
+
+
+static bool allocate_image(Image *img, int width, int height);
+
+
+static size_t image_stride(int width);
+
+
+static bool detach_image(Image *img);
+
+static bool clone_image(const Image *img, Image *copy);
+
+
+static void free_image(Image img);
+
+
+static inline Pixel *image_row(const Image *img, int row) {
+	return img->pixels + (size_t) row * img->stride;
+}
+
+
+static inline Pixel *view_row(const ImageView *view, int row) {
+	return view->pixels + (size_t) row * view->stride;
+}
+
+
+static ImageView image_region(const Image *img, int row, int col, int width, int height);
+
+
+static inline uint32_t pack_rgb(Pixel pixel) {
+	return (uint32_t) pixel.r << 16 | (uint32_t) pixel.g << 8 | pixel.b;
+}
+
+
+static bool palette_init(Palette *palette);
+
+
+static int palette_insert(Palette *palette, Pixel color);
+
+
+static int palette_find(const Palette *palette, Pixel color);
+
+
+static void palette_free(Palette *palette);
+
+
+static inline bool pixel_equal(Pixel a, Pixel b) {
+	return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+
+static bool clip_copy_region(int width, int height, CopyParams copy, PasteParams paste, CopyParams *clipped);
+
+
+static int copy_paste(Image *ptr, CopyParams copy, PasteParams paste, int threads);
+
+
+static int render_message(Image *ptr, Font *font, RenderParams render, int threads);
+
+
+static int default_threads(void);
+
+
+static int parse_job(int argc, char **argv, int threads, bool sharedStdio, Job *job);
+
+
+static int run_job(Job *job, FontCache *fonts);
+
+
+static void free_job(Job *job);
+
+
+static int run_batch(const char *manifestPath, int threads);
+
+
+static int parse_batch_line(const char *text, int lineNumber, Batch *batch);
+
+
+static char **split_arguments(char *line, int *argc);
+
+
+static void *batch_worker(void *arg);
+
+
+static int run_server(const char *socketPath, int threads);
+
+
+static void *serve_worker(void *arg);
+
+
+static int serve_request(Server *server, const char *text);
+
+
+static int run_client(const char *socketPath, int argc, char **argv);
+
+
+static bool socket_address(const char *socketPath, struct sockaddr_un *address);
+
+
+static int resolve_threads(int threads);
+
+
+static int image_from_reader(RowReader *reader, int threads, hw2_image **image);
+
+
+static ImageFormat library_format(hw2_format format);
+
+
+static int parse_script(const char *filepath, Script *script);
+
+
+static int parse_script_line(char *line, Script *script, int *lastCopy);
+
+
+static int check_messages(const Script *script, const RenderParams *render, FontCache *cache);
+
+
+static int run_script(Image *img, const Script *script, FontCache *cache, int threads);
+
+
+static void free_script(Script *script);
+
+
+static Font *font_cache_get(FontCache *cache, const char *fontPath);
+
+
+static void font_cache_free(FontCache *cache);
+
+static bool font_cache_share(FontCache *copy, const FontCache *cache, pthread_mutex_t *lock);
+
+static void font_cache_remove(FontCache *cache, int i);
+
+
+static Font *load_render_font(const char *fontPath);
+
+
+static int compile_font(const char *fontPath, const char *outputPath);
+
+
+static Font *load_compiled_font(FileData *file);
+
+static bool compiled_glyph_valid(const FontGlyphEntry *entry, int rows, const int32_t *rowRuns, const GlyphRun *runs);
+
+
+static void free_render_font(Font *font);
+
+
+static bool message_supported(Font *font, const char *message, bool report);
+
+
+static bool layout_message(Font *font, RenderParams render, int width, int height, MessageLayout *layout);
+
+
+static void draw_layout(Image *band, int firstRow, const MessageLayout *layout, int threads);
+
+
+static void *raster_rows(void *arg);
+
+
+static void free_layout(MessageLayout *layout);
+
+
+static char **loadFontsRaw(const char *filename);
+
+
+static FontChar *getFontChar(Font *font, char key);
+
+
+static const ScaledGlyph *getScaledChar(Font *font, FontChar *fontChar, int fontSize, MessageLayout *layout);
+
+
+static ScaledGlyph *scaleFontChar(const FontChar *fontChar, int fontSize);
+
+
+static char *fontKeys(const char *line);
+
+
+static void freeFontsRaw(char **fonts);
+
+
+static void initFont(Font *font, int numChars);
+
+
+static bool addFontChar(Font *font, char key, const uint64_t *bits, int wordsPerRow, int rows, int cols, int index);
+
+
+static bool buildGlyphRuns(FontChar *fontChar);
+
+
+static int glyphScan(const uint64_t *row, int from, int limit, bool set);
+
+
+static void freeFont(Font *font);
+
+
+static Font *loadFont(char **rawFont);
+
+
+static void fill_white_span(Pixel *row, int length);
+
+
+static bool *columnOccupancy(char **rawFont, size_t *width);
+
+
+static void freeFontChar(const Font *font, int i);
+
+
+static bool fontOverlaps(int width, int height, int64_t row, int64_t col, const FontChar *pChar, int fontSize);
+
+int hw2_run(int argc, char **argv) {
+	Job job;
+	optind = 0;
+	int result = parse_job(argc, argv, default_threads(), false, &job);
+	if (result != 0) {
+		return result;
+	}
+	if (job.batchPath != NULL) {
+		return run_batch(job.batchPath, job.load.threads);
+	}
+	if (job.servePath != NULL) {
+		return run_server(job.servePath, job.load.threads);
+	}
+	if (job.clientPath != NULL) {
+		return run_client(job.clientPath, job.clientArgc, job.clientArgv);
+	}
+	if (job.compileFontPath != NULL) {
+		return compile_font(job.compileFontPath, job.outputPath);
+	}
+
+	FontCache fonts = {NULL, 0, 0, 0, NULL};
+	result = run_job(&job, &fonts);
+	font_cache_free(&fonts);
+	free_job(&job);
+	return result;
+}
+
+static int default_threads(void) {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores < 1 ? 1 : cores > MAX_THREADS ? MAX_THREADS : (int) cores;
+}
+
+static int parse_job(int argc, char **argv, int threads, bool sharedStdio, Job *job) {
+	memset(job, 0, sizeof(*job));
+	job->load.threads = threads;
+	if (argc < 2) {
+		return MISSING_ARGUMENT;
+	}
+
+	int o;
+	int flag1 = 0;
+	int flag2 = 0;
+	int flag3 = 0;
+	int flag4 = 0;
+	int flag5 = 0;
+	int flag6 = 0;
+	char *input_filename = NULL, *output_filename = NULL;
+	char *copyParams = NULL;
+	char *pasteParams = NULL;
+	char *renderParams = NULL;
+	char *scriptPath = NULL;
+	static const struct option longOptions[] = {
+		{"ppm-format", required_argument, NULL, OPT_PPM_FORMAT},
+		{"sbu-format", required_argument, NULL, OPT_SBU_FORMAT},
+		{"format", required_argument, NULL, OPT_FORMAT},
+		{"max-memory", required_argument, NULL, OPT_MAX_MEMORY},
+		{"threads", required_argument, NULL, OPT_THREADS},
+		{"compile-font", required_argument, NULL, OPT_COMPILE_FONT},
+		{"batch", required_argument, NULL, OPT_BATCH},
+		{"serve", required_argument, NULL, OPT_SERVE},
+		{"client", required_argument, NULL, OPT_CLIENT},
+		{NULL, 0, NULL, 0}
+	};
+	while ((o = getopt_long(argc, argv, "i:o:c:p:r:s:", longOptions, NULL)) != -1) {
+		switch (o) {
+			case 'i':
+				if (flag1) return DUPLICATE_ARGUMENT;
+				flag1 = true;
+				input_filename = optarg;
+				if (input_filename == NULL) return MISSING_ARGUMENT;
+				if (startWith(input_filename, "-") && strcmp(input_filename, "-") != 0) return MISSING_ARGUMENT;
+				break;
+			case 'o':
+				if (flag2) return DUPLICATE_ARGUMENT;
+				flag2 = true;
+				output_filename = optarg;
+				if (startWith(output_filename, "-") && strcmp(output_filename, "-") != 0) return MISSING_ARGUMENT;
+				break;
+			case 'c':
+				if (flag3) return DUPLICATE_ARGUMENT;
+				flag3 = 1;
+				copyParams = optarg;
+				if (startWith(copyParams, "-")) return MISSING_ARGUMENT;
+				break;
+			case 'p':
+				if (flag4) return DUPLICATE_ARGUMENT;
+				flag4 = 1;
+				pasteParams = optarg;
+				if (startWith(pasteParams, "-")) return MISSING_ARGUMENT;
+				break;
+			case 'r':
+				if (flag5) return DUPLICATE_ARGUMENT;
+				flag5 = 1;
+				renderParams = optarg;
+				if (startWith(renderParams, "-")) return MISSING_ARGUMENT;
+				break;
+			case 's':
+				if (flag6) return DUPLICATE_ARGUMENT;
+				flag6 = 1;
+				scriptPath = optarg;
+				if (startWith(scriptPath, "-") && strcmp(scriptPath, "-") != 0) return MISSING_ARGUMENT;
+				break;
+			case OPT_PPM_FORMAT:
+				if (startWith(optarg, "-")) return MISSING_ARGUMENT;
+				if (strcasecmp(optarg, "P6") == 0) {
+					job->save.binaryPpm = true;
+				} else if (strcasecmp(optarg, "P3") == 0) {
+					job->save.binaryPpm = false;
+				} else {
+					return UNRECOGNIZED_ARGUMENT;
+				}
+				break;
+			case OPT_SBU_FORMAT:
+				if (startWith(optarg, "-")) return MISSING_ARGUMENT;
+				if (strcasecmp(optarg, "binary") == 0) {
+					job->save.binarySbu = true;
+				} else if (strcasecmp(optarg, "text") == 0) {
+					job->save.binarySbu = false;
+				} else {
+					return UNRECOGNIZED_ARGUMENT;
+				}
+				break;
+			case OPT_FORMAT:
+				if (startWith(optarg, "-")) return MISSING_ARGUMENT;
+				if (strcasecmp(optarg, "ppm") == 0) {
+					job->save.type = "ppm";
+				} else if (strcasecmp(optarg, "sbu") == 0) {
+					job->save.type = "sbu";
+				} else {
+					return UNRECOGNIZED_ARGUMENT;
+				}
+				break;
+			case OPT_MAX_MEMORY:
+				if (startWith(optarg, "-")) return MISSING_ARGUMENT;
+				if (!parse_size(optarg, &job->maxMemory) || job->maxMemory == 0) return UNRECOGNIZED_ARGUMENT;
+				break;
+			case OPT_THREADS:
+				if (startWith(optarg, "-")) return MISSING_ARGUMENT;
+				job->load.threads = parse_threads(optarg);
+				if (job->load.threads == 0) return UNRECOGNIZED_ARGUMENT;
+				break;
+			case OPT_COMPILE_FONT:
+				if (startWith(optarg, "-")) return MISSING_ARGUMENT;
+				job->compileFontPath = optarg;
+				break;
+			case OPT_BATCH:
+				if (job->batchPath != NULL) return DUPLICATE_ARGUMENT;
+				if (startWith(optarg, "-") && strcmp(optarg, "-") != 0) return MISSING_ARGUMENT;
+				job->batchPath = optarg;
+				break;
+			case OPT_SERVE:
+				if (job->servePath != NULL) return DUPLICATE_ARGUMENT;
+				if (startWith(optarg, "-")) return MISSING_ARGUMENT;
+				job->servePath = optarg;
+				break;
+			case OPT_CLIENT:
+				// Everything after the socket path is the job, passed to the server untouched.
+				if (startWith(optarg, "-")) return MISSING_ARGUMENT;
+				if (flag1 || flag2 || flag3 || flag4 || flag5 || flag6) return UNRECOGNIZED_ARGUMENT;
+				job->clientPath = optarg;
+				job->clientArgc = argc - optind;
+				job->clientArgv = argv + optind;
+				return 0;
+			default:
+				if (optopt >= OPT_PPM_FORMAT) return MISSING_ARGUMENT;
+				if (charIn(optopt, "iocprs") == false) {
+					return UNRECOGNIZED_ARGUMENT;
+				} else {
+					return MISSING_ARGUMENT;
+				}
+		}
+	}
+
+	if (job->servePath != NULL) {
+		// Requests name their own files and operations; only --threads applies to the server itself.
+		if (flag1 || flag2 || flag3 || flag4 || flag5 || flag6 || job->compileFontPath != NULL ||
+			job->batchPath != NULL || job->maxMemory > 0) {
+			return UNRECOGNIZED_ARGUMENT;
+		}
+		return 0;
+	}
+	if (job->batchPath != NULL) {
+		// Every job names its own files and operations; only --threads applies to the batch itself.
+		if (flag1 || flag2 || flag3 || flag4 || flag5 || flag6 || job->compileFontPath != NULL || job->maxMemory > 0) {
+			return UNRECOGNIZED_ARGUMENT;
+		}
+		if (strcmp(job->batchPath, "-") != 0 && access(job->batchPath, F_OK) == -1) return INPUT_FILE_MISSING;
+		return 0;
+	}
+	if (job->compileFontPath != NULL) {
+		if (!flag2) return MISSING_ARGUMENT;
+		if (access(job->compileFontPath, F_OK) == -1) return INPUT_FILE_MISSING;
+		job->outputPath = output_filename;
+		return 0;
+	}
+	if (!flag1 || !flag2) return MISSING_ARGUMENT;
+	if (strcmp(input_filename, "-") != 0 && access(input_filename, F_OK) == -1) return INPUT_FILE_MISSING;
+	if (!output_writable(output_filename)) return OUTPUT_FILE_UNWRITABLE;
+	if (strcmp(output_filename, "-") == 0 && job->save.type == NULL) return MISSING_ARGUMENT;
+	if (output_format(output_filename, job->save) == FORMAT_NONE) return UNRECOGNIZED_ARGUMENT;
+	if (flag4 && !flag3) return C_ARGUMENT_MISSING;
+	if (flag3 && checkCopyParams(copyParams) == false) return C_ARGUMENT_INVALID;
+	if (flag4 && checkPasteParams(pasteParams) == false) return P_ARGUMENT_INVALID;
+	if (flag5 && checkRenderParams(renderParams) == false) return R_ARGUMENT_INVALID;
+	if (flag6 && job->maxMemory > 0) return UNRECOGNIZED_ARGUMENT;
+	if (flag6 && strcmp(scriptPath, "-") == 0 && strcmp(input_filename, "-") == 0) return UNRECOGNIZED_ARGUMENT;
+	if (sharedStdio) {
+		// Jobs in a batch or on a server share the process's stdin and stdout, so they must name real files.
+		if (strcmp(input_filename, "-") == 0 || strcmp(output_filename, "-") == 0 ||
+			(flag6 && strcmp(scriptPath, "-") == 0)) {
+			return UNRECOGNIZED_ARGUMENT;
+		}
+	}
+	if (flag6) {
+		int result = parse_script(scriptPath, &job->script);
+		if (result != 0) return result;
+	}
+
+	job->inputPath = input_filename;
+	job->outputPath = output_filename;
+	job->pasting = flag3 && flag4;
+	if (flag3) {
+		char **pString = split(copyParams, ",");
+		job->copy = (CopyParams) {atoi(pString[0]), atoi(pString[1]), atoi(pString[2]), atoi(pString[3])};
+		freeArr(pString);
+	}
+	if (flag4) {
+		char **pString = split(pasteParams, ",");
+		job->paste = (PasteParams) {atoi(pString[0]), atoi(pString[1])};
+		freeArr(pString);
+	}
+	if (flag5) {
+		job->renderArgs = split(renderParams, ",");
+		job->render = (RenderParams) {job->renderArgs[0], job->renderArgs[1], atoi(job->renderArgs[2]),
+									  atoi(job->renderArgs[3]), atoi(job->renderArgs[4])};
+	}
+	return 0;
+}
+
+static int run_job(Job *job, FontCache *fonts) {
+	RenderParams *render = job->renderArgs != NULL ? &job->render : NULL;
+	bool inPlace = same_file(job->inputPath, job->outputPath);
+	if (job->maxMemory > 0) {
+		// Streaming writes the output while still reading the input, so they must be different files.
+		if (inPlace) {
+			return OUTPUT_FILE_UNWRITABLE;
+		}
+		return stream_image(job->inputPath, job->outputPath, output_format(job->outputPath, job->save),
+							job->pasting ? &job->copy : NULL, job->pasting ? &job->paste : NULL, render,
+							job->maxMemory);
+	}
+	ImageFormat format = output_format(job->outputPath, job->save);
+	if (format == FORMAT_NONE) {
+		return UNRECOGNIZED_ARGUMENT;
+	}
+
+	// Fonts are loaded and messages checked before the image, so an unsupported character fails fast.
+	int result = check_messages(&job->script, render, fonts);
+	if (result != 0) {
+		return result;
+	}
+
+	Image img;
+	if (!load_image(job->inputPath, job->load, &img)) {
+		return INPUT_FILE_MISSING;
+	}
+	if (inPlace && !detach_image(&img)) {
+		free_image(img);
+		return MISSING_ARGUMENT;
+	}
+
+	if (job->pasting) {
+		copy_paste(&img, job->copy, job->paste, job->load.threads);
+	}
+	if (render != NULL) {
+		result = render_message(&img, font_cache_get(fonts, render->fontPath), *render, job->load.threads);
+	}
+	if (result == 0) {
+		result = run_script(&img, &job->script, fonts, job->load.threads);
+	}
+	if (result == 0 && !save_with_format(&img, job->outputPath, format)) {
+		result = OUTPUT_FILE_UNWRITABLE;
+	}
+	free_image(img);
+	return result;
+}
+
+static void free_job(Job *job) {
+	if (job->renderArgs != NULL) {
+		freeArr(job->renderArgs);
+	}
+	free_script(&job->script);
+}
+
+static int run_batch(const char *manifestPath, int threads) {
+	// Jobs are parsed and their fonts loaded here, one line at a time, since getopt keeps global state;
+	// only then do the workers start, and they treat the shared font cache as read-only.
+	FILE *file = strcmp(manifestPath, "-") == 0 ? stdin : fopen(manifestPath, "r");
+	if (file == NULL) {
+		return INPUT_FILE_MISSING;
+	}
+	Batch batch;
+	memset(&batch, 0, sizeof(batch));
+	char *line = NULL;
+	size_t size = 0;
+	int lineNumber = 0;
+	int result = 0;
+	while (result == 0 && getline(&line, &size, file) != -1) {
+		lineNumber++;
+		result = parse_batch_line(line, lineNumber, &batch);
+	}
+	free(line);
+	if (file != stdin) {
+		fclose(file);
+	}
+
+	if (result == 0 && batch.count > 0) {
+		int workers = threads < batch.count ? threads : batch.count;
+		BatchWorker *tasks = malloc((size_t) workers * sizeof(BatchWorker));
+		if (tasks == NULL) {
+			result = MISSING_ARGUMENT;
+		} else {
+			pthread_mutex_init(&batch.lock, NULL);
+			for (int i = 0; i < workers; i++) {
+				tasks[i].batch = &batch;
+			}
+			run_parallel(tasks, sizeof(BatchWorker), workers, batch_worker);
+			pthread_mutex_destroy(&batch.lock);
+			free(tasks);
+		}
+	}
+
+	// One "LINE CODE" pair per job in manifest order; the batch exits with the first failing job's code.
+	for (int i = 0; i < batch.count; i++) {
+		BatchJob *batchJob = &batch.jobs[i];
+		if (result == 0) {
+			printf("%d %d\n", batchJob->lineNumber, batchJob->result);
+		}
+		free_job(&batchJob->job);
+		free(batchJob->argv);
+		free(batchJob->line);
+	}
+	for (int i = 0; result == 0 && i < batch.count; i++) {
+		result = batch.jobs[i].result;
+	}
+	free(batch.jobs);
+	font_cache_free(&batch.fonts);
+	return result;
+}
+
+static int parse_batch_line(const char *text, int lineNumber, Batch *batch) {
+	char *line = strdup(text);
+	if (line == NULL) {
+		return MISSING_ARGUMENT;
+	}
+	int argc = 0;
+	char **argv = split_arguments(line, &argc);
+	if (argv == NULL) {
+		free(line);
+		return MISSING_ARGUMENT;
+	}
+	if (argc == 1 || argv[1][0] == '#') {
+		free(argv);
+		free(line);
+		return 0;
+	}
+	if (batch->count == batch->capacity) {
+		int capacity = batch->capacity == 0 ? 16 : batch->capacity * 2;
+		BatchJob *jobs = realloc(batch->jobs, (size_t) capacity * sizeof(BatchJob));
+		if (jobs == NULL) {
+			free(argv);
+			free(line);
+			return MISSING_ARGUMENT;
+		}
+		batch->jobs = jobs;
+		batch->capacity = capacity;
+	}
+
+	// Each job runs single-threaded unless its line asks otherwise; the pool supplies the parallelism.
+	BatchJob *batchJob = &batch->jobs[batch->count++];
+	batchJob->line = line;
+	batchJob->argv = argv;
+	batchJob->lineNumber = lineNumber;
+	optind = 0;
+	batchJob->result = parse_job(argc, argv, 1, true, &batchJob->job);
+	if (batchJob->result == 0 && (batchJob->job.batchPath != NULL || batchJob->job.compileFontPath != NULL ||
+								  batchJob->job.servePath != NULL || batchJob->job.clientPath != NULL)) {
+		batchJob->result = UNRECOGNIZED_ARGUMENT;
+	}
+	if (batchJob->result == 0 && batchJob->job.maxMemory == 0) {
+		RenderParams *render = batchJob->job.renderArgs != NULL ? &batchJob->job.render : NULL;
+		batchJob->result = check_messages(&batchJob->job.script, render, &batch->fonts);
+	}
+	return 0;
+}
+
+static char **split_arguments(char *line, int *argc) {
+	// Words are separated by blanks; double quotes group a word and are removed, and a backslash takes the
+	// character after it literally, as a shell would.
+	size_t capacity = 8;
+	char **argv = malloc(capacity * sizeof(char *));
+	if (argv == NULL) {
+		return NULL;
+	}
+	int count = 0;
+	argv[count++] = "hw2_main";
+	char *read = line;
+	while (true) {
+		while (isspace((unsigned char) *read)) {
+			read++;
+		}
+		if (*read == '\0') {
+			break;
+		}
+		char *word = read;
+		char *write = read;
+		bool quoted = false;
+		while (*read != '\0' && (quoted || !isspace((unsigned char) *read))) {
+			if (*read == '\\' && read[1] != '\0') {
+				*write++ = *++read;
+			} else if (*read == '"') {
+				quoted = !quoted;
+			} else {
+				*write++ = *read;
+			}
+			read++;
+		}
+		if (*read != '\0') {
+			read++;
+		}
+		*write = '\0';
+		if ((size_t) count + 1 >= capacity) {
+			capacity *= 2;
+			char **grown = realloc(argv, capacity * sizeof(char *));
+			if (grown == NULL) {
+				free(argv);
+				return NULL;
+			}
+			argv = grown;
+		}
+		argv[count++] = word;
+	}
+	argv[count] = NULL;
+	*argc = count;
+	return argv;
+}
+
+static void *batch_worker(void *arg) {
+	Batch *batch = ((BatchWorker *) arg)->batch;
+	while (true) {
+		pthread_mutex_lock(&batch->lock);
+		int i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->count) {
+			break;
+		}
+		BatchJob *batchJob = &batch->jobs[i];
+		if (batchJob->result == 0) {
+			batchJob->result = run_job(&batchJob->job, &batch->fonts);
+		}
+	}
+	return NULL;
+}
+
+static int run_server(const char *socketPath, int threads) {
+	// Workers share one listening socket and accept connections independently; each connection may send
+	// any number of request lines and gets one exit code line back per request.
+	struct sockaddr_un address;
+	if (!socket_address(socketPath, &address)) {
+		return UNRECOGNIZED_ARGUMENT;
+	}
+	Server server;
+	memset(&server, 0, sizeof(server));
+	server.fonts.limit = FONT_CACHE_MAX;
+	server.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server.fd == -1) {
+		return OUTPUT_FILE_UNWRITABLE;
+	}
+	// Only a socket left behind by an earlier server is replaced; any other file at the path is kept.
+	struct stat st;
+	if (lstat(socketPath, &st) == 0 && (!S_ISSOCK(st.st_mode) || unlink(socketPath) == -1)) {
+		close(server.fd);
+		return OUTPUT_FILE_UNWRITABLE;
+	}
+	struct stat bound;
+	if (bind(server.fd, (struct sockaddr *) &address, sizeof(address)) == -1 || lstat(socketPath, &bound) == -1 ||
+		listen(server.fd, SOMAXCONN) == -1) {
+		close(server.fd);
+		return OUTPUT_FILE_UNWRITABLE;
+	}
+	pthread_mutex_init(&server.lock, NULL);
+
+	ServeWorker *tasks = malloc((size_t) threads * sizeof(ServeWorker));
+	if (tasks != NULL) {
+		for (int i = 0; i < threads; i++) {
+			tasks[i] = (ServeWorker) {&server, -1};
+		}
+		server.workers = tasks;
+		server.numWorkers = threads;
+		run_parallel(tasks, sizeof(ServeWorker), threads, serve_worker);
+		free(tasks);
+	}
+
+	close(server.fd);
+	// The path may have been taken over by another server in the meantime; only this server's socket is removed.
+	if (lstat(socketPath, &st) == 0 && st.st_dev == bound.st_dev && st.st_ino == bound.st_ino) {
+		unlink(socketPath);
+	}
+	pthread_mutex_destroy(&server.lock);
+	font_cache_free(&server.fonts);
+	return tasks != NULL ? 0 : MISSING_ARGUMENT;
+}
+
+static void *serve_worker(void *arg) {
+	// Image and output buffers are kept in this thread's scratch between requests instead of being freed.
+	ServeWorker *worker = arg;
+	Server *server = worker->server;
+	Scratch scratch = {NULL, 0, NULL};
+	workerScratch = &scratch;
+	while (true) {
+		int client = accept(server->fd, NULL, NULL);
+		pthread_mutex_lock(&server->lock);
+		bool stopping = server->stopping;
+		if (client != -1 && !stopping) {
+			worker->client = client;
+		}
+		pthread_mutex_unlock(&server->lock);
+		if (client == -1) {
+			if (stopping || (errno != EINTR && errno != ECONNABORTED)) {
+				break;
+			}
+			continue;
+		}
+		if (stopping) {
+			close(client);
+			break;
+		}
+		FILE *requests = fdopen(client, "r");
+		if (requests == NULL) {
+			close(client);
+			continue;
+		}
+		char *line = NULL;
+		size_t size = 0;
+		while (getline(&line, &size, requests) != -1) {
+			int result = serve_request(server, line);
+			char reply[16];
+			int length = snprintf(reply, sizeof(reply), "%d\n", result);
+			if (send(client, reply, (size_t) length, MSG_NOSIGNAL) != length) {
+				break;
+			}
+		}
+		free(line);
+		pthread_mutex_lock(&server->lock);
+		worker->client = -1;
+		pthread_mutex_unlock(&server->lock);
+		fclose(requests);
+	}
+	workerScratch = NULL;
+	free(scratch.pixels);
+	free(scratch.output);
+	return NULL;
+}
+
+static int serve_request(Server *server, const char *text) {
+	// Parsing and font loading hold the server lock; the job itself runs against a private snapshot of the
+	// font cache, whose fonts stay loaded until the server exits.
+	char *line = strdup(text);
+	if (line == NULL) {
+		return MISSING_ARGUMENT;
+	}
+	int argc = 0;
+	char **argv = split_arguments(line, &argc);
+	if (argv == NULL) {
+		free(line);
+		return MISSING_ARGUMENT;
+	}
+	if (argc == 2 && strcmp(argv[1], "shutdown") == 0) {
+		// Open connections would keep their workers waiting for requests; ending their read side lets each
+		// worker answer the request in hand and return.
+		pthread_mutex_lock(&server->lock);
+		server->stopping = true;
+		for (int i = 0; i < server->numWorkers; i++) {
+			if (server->workers[i].client != -1) {
+				shutdown(server->workers[i].client, SHUT_RD);
+			}
+		}
+		pthread_mutex_unlock(&server->lock);
+		shutdown(server->fd, SHUT_RDWR);
+		free(argv);
+		free(line);
+		return 0;
+	}
+
+	Job job;
+	FontCache fonts = {NULL, 0, 0, 0, NULL};
+	pthread_mutex_lock(&server->lock);
+	optind = 0;
+	int result = parse_job(argc, argv, 1, true, &job);
+	if (result == 0 && (job.batchPath != NULL || job.compileFontPath != NULL || job.servePath != NULL ||
+						job.clientPath != NULL)) {
+		result = UNRECOGNIZED_ARGUMENT;
+	}
+	if (result == 0 && job.maxMemory == 0) {
+		result = check_messages(&job.script, job.renderArgs != NULL ? &job.render : NULL, &server->fonts);
+	}
+	if (result == 0 && !font_cache_share(&fonts, &server->fonts, &server->lock)) {
+		result = MISSING_ARGUMENT;
+	}
+	pthread_mutex_unlock(&server->lock);
+
+	if (result == 0) {
+		result = run_job(&job, &fonts);
+	}
+	font_cache_free(&fonts);
+	free_job(&job);
+	free(argv);
+	free(line);
+	return result;
+}
+
+static int run_client(const char *socketPath, int argc, char **argv) {
+	// The job's arguments are sent as one line that split_arguments turns back into the same words: each is
+	// quoted, with its quotes and backslashes escaped. The reply is the job's exit code.
+	struct sockaddr_un address;
+	if (!socket_address(socketPath, &address)) {
+		return UNRECOGNIZED_ARGUMENT;
+	}
+	size_t length = 1;
+	for (int i = 0; i < argc; i++) {
+		if (strchr(argv[i], '\n') != NULL) {
+			// A line break would end the request early.
+			return UNRECOGNIZED_ARGUMENT;
+		}
+		length += 2 * strlen(argv[i]) + 3;
+	}
+	char *request = malloc(length);
+	if (request == NULL) {
+		return MISSING_ARGUMENT;
+	}
+	char *end = request;
+	for (int i = 0; i < argc; i++) {
+		if (i > 0) {
+			*end++ = ' ';
+		}
+		*end++ = '"';
+		for (const char *c = argv[i]; *c != '\0'; c++) {
+			if (*c == '"' || *c == '\\') {
+				*end++ = '\\';
+			}
+			*end++ = *c;
+		}
+		*end++ = '"';
+	}
+	*end++ = '\n';
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1 || connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+		if (fd != -1) {
+			close(fd);
+		}
+		free(request);
+		return INPUT_FILE_MISSING;
+	}
+	bool sent = write(fd, request, (size_t) (end - request)) == end - request;
+	free(request);
+	char reply[16] = {0};
+	size_t received = 0;
+	while (sent && received < sizeof(reply) - 1) {
+		ssize_t count = read(fd, reply + received, sizeof(reply) - 1 - received);
+		if (count <= 0) {
+			break;
+		}
+		received += (size_t) count;
+		if (reply[received - 1] == '\n') {
+			break;
+		}
+	}
+	close(fd);
+	if (received == 0 || reply[received - 1] != '\n') {
+		return INPUT_FILE_MISSING;
+	}
+	return atoi(reply);
+}
+
+static bool socket_address(const char *socketPath, struct sockaddr_un *address) {
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(address->sun_path)) {
+		return false;
+	}
+	strcpy(address->sun_path, socketPath);
+	return true;
+}
+
+static bool clip_copy_region(int width, int height, CopyParams copy, PasteParams paste, CopyParams *clipped) {
+	// A pixel is pasted only when both its source and its destination lie inside the image.
+	*clipped = copy;
+	if (copy.row >= height || copy.column >= width || paste.row >= height || paste.column >= width) {
+		return false;
+	}
+	if (clipped->width > width - copy.column) clipped->width = width - copy.column;
+	if (clipped->width > width - paste.column) clipped->width = width - paste.column;
+	if (clipped->height > height - copy.row) clipped->height = height - copy.row;
+	if (clipped->height > height - paste.row) clipped->height = height - paste.row;
+	return clipped->width > 0 && clipped->height > 0;
+}
+
+static int copy_paste(Image *ptr, CopyParams copy, PasteParams paste, int threads) {
+	CopyParams clipped;
+	if (!clip_copy_region(ptr->width, ptr->height, copy, paste, &clipped)) {
+		return 0;
+	}
+	RowCopy task = {
+		image_region(ptr, clipped.row, clipped.column, clipped.width, clipped.height),
+		image_region(ptr, paste.row, paste.column, clipped.width, clipped.height),
+		0, clipped.height, paste.row > clipped.row
+	};
+	bool overlaps = paste.row < clipped.row + clipped.height && clipped.row < paste.row + clipped.height &&
+					paste.column < clipped.column + clipped.width && clipped.column < paste.column + clipped.width;
+	size_t bytes = (size_t) clipped.width * (size_t) clipped.height * sizeof(Pixel);
+	if (threads > 1 && !overlaps && bytes >= PARALLEL_MIN_BYTES) {
+		if ((size_t) threads > bytes / (PARALLEL_MIN_BYTES / 4)) {
+			threads = (int) (bytes / (PARALLEL_MIN_BYTES / 4));
+		}
+		if (threads > clipped.height) {
+			threads = clipped.height;
+		}
+		RowCopy *tasks = malloc((size_t) threads * sizeof(RowCopy));
+		if (tasks != NULL) {
+			for (int i = 0; i < threads; i++) {
+				tasks[i] = task;
+				tasks[i].firstRow = (int) ((int64_t) clipped.height * i / threads);
+				tasks[i].lastRow = (int) ((int64_t) clipped.height * (i + 1) / threads);
+			}
+			bool ok = run_parallel(tasks, sizeof(RowCopy), threads, copy_rows);
+			free(tasks);
+			if (ok) {
+				return 0;
+			}
+		}
+	}
+	copy_rows(&task);
+	return 0;
+}
+
+static void *copy_rows(void *arg) {
+	// Like memmove on the whole rectangle: when the destination lies below the source the rows are moved
+	// bottom-up, so overlapping source rows are read before they are overwritten.
+	RowCopy *task = arg;
+	size_t rowBytes = (size_t) task->src.width * sizeof(Pixel);
+	if (task->bottomUp) {
+		for (int i = task->lastRow - 1; i >= task->firstRow; i--) {
+			memmove(view_row(&task->dst, i), view_row(&task->src, i), rowBytes);
+		}
+	} else {
+		for (int i = task->firstRow; i < task->lastRow; i++) {
+			memmove(view_row(&task->dst, i), view_row(&task->src, i), rowBytes);
+		}
+	}
+	return NULL;
+}
+
+static bool checkRenderParams(char *params) {
+	char **pString = split(params, ",");
+	if (pString == NULL) {
+		return false;
+	}
+	if (arrayLength(pString) != 5) {
+		freeArr(pString);
+		return false;
+	}
+
+	char *path = pString[1];
+	if (access(path, F_OK) == -1) {
+		freeArr(pString);
+		return false;
+	}
+
+	for (int i = 2; i < 5; i++) {
+		for (int j = 0; pString[i][j]; j++) {
+			if (!isdigit(pString[i][j])) {
+				freeArr(pString);
+				return false;
+			}
+		}
+	}
+	freeArr(pString);
+	return true;
+}
+
+static bool checkPasteParams(char *params) {
+	char **pString = split(params, ",");
+	if (pString == NULL) {
+		return false;
+	}
+
+	if (arrayLength(pString) != 2) {
+		freeArr(pString);
+		return false;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; pString[i][j]; j++) {
+			if (!isdigit(pString[i][j])) {
+				freeArr(pString);
+				return false;
+			}
+		}
+	}
+	freeArr(pString);
+	return true;
+}
+
+static int count_words(const char *str, const char *delim, int numwords) {
+	int i;
+
+	for (i = 0; str[i] != '\0'; i++) {
+		if (!charIn(str[i], delim) &&
+			(charIn(str[i + 1], delim) || !str[i + 1])) {
+			numwords++;
+		}
+	}
+	return (numwords);
+}
+
+static char **split(const char *str, const char *delim) {
+	int i, j, k, m, numwords = 0;
+	char **s;
+
+	if (str == NULL || str[0] == 0)
+		return (NULL);
+	if (!delim)
+		delim = " ";
+
+	numwords = count_words(str, delim, numwords);
+	if (numwords == 0) {
+		return (NULL);
+	}
+	s = malloc((1 + numwords) * sizeof(char *));
+	if (!s)
+		return (NULL);
+	for (i = 0, j = 0; j < numwords; j++) {
+		while (charIn(str[i], delim) == 1)
+			i++;
+
+		k = 0;
+		while (!charIn(str[i + k], delim) && str[i + k])
+			k++;
+
+		s[j] = malloc((k + 1) * sizeof(char));
+		if (!s[j]) {
+			for (k = 0; k < j; k++)
+				free(s[k]);
+
+			free(s);
+			return (NULL);
+		}
+		for (m = 0; m < k; m++)
+			s[j][m] = str[i++];
+		s[j][m] = 0;
+	}
+	s[j] = NULL;
+	return (s);
+}
+
+static int arrayLength(char **pString) {
+	int length = 0;
+	while (pString[length] != NULL) {
+		length++;
+	}
+	return length;
+}
+
+static void freeArr(char **pString) {
+	for (int i = 0; pString[i] != NULL; i++) {
+		free(pString[i]);
+	}
+	free(pString);
+}
+
+static bool checkCopyParams(char *params) {
+	char **pString = split(params, ",");
+	if (pString == NULL) {
+		return false;
+	}
+	if (arrayLength(pString) != 4) {
+		freeArr(pString);
+		return false;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; pString[i][j]; j++) {
+			if (!isdigit(pString[i][j])) {
+				freeArr(pString);
+				return false;
+			}
+		}
+	}
+	freeArr(pString);
+	return true;
+}
+
+static bool startWith(const char *string1, const char *string) {
+	for (size_t i = 0; i < strlen(string); i++) {
+		if (string1[i] != string[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool charIn(int option, const char *string) {
+	for (size_t i = 0; i < strlen(string); i++) {
+		if (option == string[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static const char *getExt(const char *filename) {
+	const char *dot = strrchr(filename, '.');
+	if (!dot || dot == filename) return ""; 
+	return dot + 1; 
+}
+
+static Image empty_image(void) {
+	Image img;
+	img.width = 0;
+	img.height = 0;
+	img.stride = 0;
+	img.pixels = NULL;
+	img.capacity = 0;
+	img.mapping = NULL;
+	img.mappingSize = 0;
+	return img;
+}
+
+static size_t image_stride(int width) {
+	// Round rows up so that every row starts on a cache line: 64 pixels are 192 bytes, three full lines.
+	size_t pixelsPerLine = PIXEL_ROW_ALIGNMENT;
+	return ((size_t) width + pixelsPerLine - 1) / pixelsPerLine * pixelsPerLine;
+}
+
+static bool allocate_image(Image *img, int width, int height) {
+	*img = empty_image();
+	img->width = width;
+	img->height = height;
+	img->stride = image_stride(width);
+	if (width <= 0 || height <= 0) {
+		img->width = 0;
+		img->height = 0;
+		return true;
+	}
+
+	size_t bytes = img->stride * (size_t) height * sizeof(Pixel);
+	Scratch *scratch = workerScratch;
+	if (scratch != NULL && scratch->pixels != NULL && scratch->pixelBytes >= bytes) {
+		img->pixels = scratch->pixels;
+		img->capacity = scratch->pixelBytes;
+		scratch->pixels = NULL;
+		memset(img->pixels, 0, bytes);
+		return true;
+	}
+	size_t alignment = PIXEL_ROW_ALIGNMENT;
+#ifdef HW2_HUGE_PAGES
+	if (bytes >= HUGE_PAGE_SIZE) {
+		alignment = HUGE_PAGE_SIZE;
+	}
+#endif
+	void *block = NULL;
+	if (posix_memalign(&block, alignment, bytes) != 0) {
+		img->width = 0;
+		img->height = 0;
+		return false;
+	}
+#if defined(HW2_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+	if (alignment == HUGE_PAGE_SIZE) {
+		madvise(block, bytes, MADV_HUGEPAGE);
+	}
+#endif
+	memset(block, 0, bytes);
+	img->pixels = block;
+	img->capacity = bytes;
+	return true;
+}
+
+static bool detach_image(Image *img) {
+	// A zero-copy image still reads from its input file's pages; this gives it pixels of its own.
+	if (img->mapping == NULL) {
+		return true;
+	}
+	Image copy;
+	if (!clone_image(img, &copy)) {
+		return false;
+	}
+	free_image(*img);
+	*img = copy;
+	return true;
+}
+
+static bool clone_image(const Image *img, Image *copy) {
+	if (!allocate_image(copy, img->width, img->height)) {
+		return false;
+	}
+	for (int i = 0; i < img->height; i++) {
+		memcpy(image_row(copy, i), image_row(img, i), (size_t) img->width * sizeof(Pixel));
+	}
+	return true;
+}
+
+static void free_image(Image img) {
+	Scratch *scratch = workerScratch;
+	if (img.mapping != NULL) {
+		munmap(img.mapping, img.mappingSize);
+	} else if (scratch != NULL && img.pixels != NULL && img.capacity <= SCRATCH_MAX_BYTES &&
+			   (scratch->pixels == NULL || scratch->pixelBytes < img.capacity)) {
+		// A serve worker keeps its largest recent pixel buffer for the next request.
+		free(scratch->pixels);
+		scratch->pixels = img.pixels;
+		scratch->pixelBytes = img.capacity;
+	} else {
+		free(img.pixels);
+	}
+}
+
+static ImageView image_region(const Image *img, int row, int col, int width, int height) {
+	ImageView view;
+	view.stride = img->stride;
+	view.width = width;
+	view.height = height;
+	if (row >= img->height || col >= img->width) {
+		view.width = 0;
+		view.height = 0;
+	}
+	if (view.width > img->width - col) {
+		view.width = img->width - col;
+	}
+	if (view.height > img->height - row) {
+		view.height = img->height - row;
+	}
+	if (view.width <= 0 || view.height <= 0) {
+		view.width = 0;
+		view.height = 0;
+	}
+	view.pixels = view.width > 0 && view.height > 0 ? image_row(img, row) + col : NULL;
+	return view;
+}
+
+static bool load_image(const char *filepath, LoadParams params, Image *img) {
+	// The format comes from the header's magic bytes, so "-" (stdin) and misnamed files load too.
+	RowReader reader;
+	if (!reader_open(&reader, filepath)) {
+		*img = empty_image();
+		return false;
+	}
+	return decode_image(&reader, params, img);
+}
+
+static bool decode_image(RowReader *reader, LoadParams params, Image *img) {
+	// Decoding reports a bad body as an empty image, so no pixels behind a non-empty header is a failure.
+	bool empty = reader->width == 0 || reader->height == 0;
+	*img = reader->format == FORMAT_PPM_ASCII || reader->format == FORMAT_PPM_BINARY
+		   ? load_ppm_reader(reader, params) : load_sbu_reader(reader);
+	return empty || img->pixels != NULL;
+}
+
+static bool map_file(const char *filepath, FileData *file) {
+	return map_descriptor(open(filepath, O_RDONLY), file);
+}
+
+static bool map_descriptor(int fd, FileData *file) {
+	file->data = NULL;
+	file->size = 0;
+	file->mapping = NULL;
+
+	if (fd == -1) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return false;
+	}
+	file->size = (size_t) st.st_size;
+
+	if (file->size > 0 && S_ISREG(st.st_mode)) {
+		// Private and writable so a P6 payload can become an image's pixels in place (copy-on-write).
+		void *mapping = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) {
+			madvise(mapping, file->size, MADV_SEQUENTIAL);
+			close(fd);
+			file->mapping = mapping;
+			file->data = mapping;
+			return true;
+		}
+	}
+
+	// Not mappable (pipe, special file, empty file): fall back to reading it into the heap.
+	size_t capacity = file->size > 0 ? file->size : 65536;
+	unsigned char *buffer = malloc(capacity);
+	size_t length = 0;
+	ssize_t got;
+	while (buffer != NULL && (got = read(fd, buffer + length, capacity - length)) > 0) {
+		length += (size_t) got;
+		if (length == capacity) {
+			unsigned char *grown = realloc(buffer, capacity * 2);
+			if (grown == NULL) {
+				free(buffer);
+				buffer = NULL;
+				break;
+			}
+			buffer = grown;
+			capacity *= 2;
+		}
+	}
+	close(fd);
+	if (buffer == NULL) {
+		return false;
+	}
+	file->data = buffer;
+	file->size = length;
+	return true;
+}
+
+static void unmap_file(FileData *file) {
+	if (file->data == NULL) {
+		return;
+	}
+	if (file->mapping != NULL) {
+		munmap(file->mapping, file->size);
+	} else {
+		free((void *) file->data);
+	}
+	file->data = NULL;
+	file->mapping = NULL;
+	file->size = 0;
+}
+
+static void scanner_skip_space(Scanner *scanner) {
+	const unsigned char *p = scanner->pos;
+	while (p < scanner->end) {
+		if (*p == '#') {
+			while (p < scanner->end && *p != '\n') {
+				p++;
+			}
+		} else if (*p == ' ' || (*p >= '\t' && *p <= '\r')) {
+			p++;
+		} else {
+			break;
+		}
+	}
+	scanner->pos = p;
+}
+
+static bool scan_u64(Scanner *scanner, uint64_t *value) {
+	scanner_skip_space(scanner);
+	const unsigned char *p = scanner->pos;
+	const unsigned char *end = scanner->end;
+	uint64_t v = 0;
+	unsigned digit;
+	if (p == end || (digit = (unsigned) (*p - '0')) > 9) {
+		return false;
+	}
+	do {
+		// Saturate instead of wrapping so oversized values fail range checks downstream.
+		v = v < (UINT64_MAX - 9) / 10 ? v * 10 + digit : UINT64_MAX;
+		p++;
+	} while (p < end && (digit = (unsigned) (*p - '0')) <= 9);
+	scanner->pos = p;
+	*value = v;
+	return true;
+}
+
+static bool scan_uint(Scanner *scanner, unsigned *value) {
+	uint64_t v;
+	if (!scan_u64(scanner, &v)) {
+		return false;
+	}
+	*value = v > UINT32_MAX ? UINT32_MAX : (unsigned) v;
+	return true;
+}
+
+static bool scan_word(Scanner *scanner, const char *word) {
+	scanner_skip_space(scanner);
+	size_t length = strlen(word);
+	if ((size_t) (scanner->end - scanner->pos) < length || memcmp(scanner->pos, word, length) != 0) {
+		return false;
+	}
+	const unsigned char *after = scanner->pos + length;
+	if (after < scanner->end && !isspace(*after)) {
+		return false;
+	}
+	scanner->pos = after;
+	return true;
+}
+
+static unsigned char scale_sample(unsigned value, unsigned maxval) {
+	if (value >= maxval) {
+		return 255;
+	}
+	return (unsigned char) ((value * 255u + maxval / 2) / maxval);
+}
+
+static unsigned char *scan_samples(Scanner *scanner, unsigned char *out, unsigned char *outEnd, unsigned maxval) {
+	const unsigned char *p = scanner->pos;
+	const unsigned char *end = scanner->end;
+	while (out < outEnd) {
+		unsigned digit = 0;
+		while (p < end && (digit = (unsigned) (*p - '0')) > 9) {
+			if (*p == '#') {
+				scanner->pos = p;
+				scanner_skip_space(scanner);
+				p = scanner->pos;
+			} else if (*p == ' ' || (*p >= '\t' && *p <= '\r')) {
+				p++;
+			} else {
+				scanner->pos = p;
+				return out;
+			}
+		}
+		if (p == end) {
+			break;
+		}
+		unsigned v = digit;
+		while (++p < end && (digit = (unsigned) (*p - '0')) <= 9) {
+			if (v < 100000000u) {
+				v = v * 10 + digit;
+			}
+		}
+		if (maxval == 255) {
+			*out++ = (unsigned char) (v > 255 ? 255 : v);
+		} else {
+			*out++ = scale_sample(v, maxval);
+		}
+	}
+	scanner->pos = p;
+	return out;
+}
+
+static bool parse_ppm_header(Scanner *scanner, unsigned *width, unsigned *height, unsigned *maxval, bool *binary) {
+	if (scan_word(scanner, "P3")) {
+		*binary = false;
+	} else if (scan_word(scanner, "P6")) {
+		*binary = true;
+	} else {
+		return false;
+	}
+	if (!scan_uint(scanner, width) || !scan_uint(scanner, height) || !scan_uint(scanner, maxval)) {
+		return false;
+	}
+	if (*maxval == 0 || *maxval > 65535 || *width > INT32_MAX || *height > INT32_MAX) {
+		return false;
+	}
+	if (*binary) {
+		// Exactly one whitespace byte separates maxval from the raster.
+		if (scanner->pos == scanner->end || !isspace(*scanner->pos)) {
+			return false;
+		}
+		scanner->pos++;
+	}
+	return true;
+}
+
+static Image load_ppm_reader(RowReader *reader, LoadParams params) {
+	Image img;
+	if (reader->format == FORMAT_PPM_BINARY && reader->maxval == 255 && reader->file.mapping != NULL) {
+		// Zero-copy: the mapping is private, so the raster is used as the pixel buffer directly. Its rows are
+		// packed, so this image does not get the PIXEL_ROW_ALIGNMENT stride that allocate_image gives.
+		img = empty_image();
+		img.width = reader->width;
+		img.height = reader->height;
+		img.stride = (size_t) reader->width;
+		img.pixels = (Pixel *) reader->body;
+		img.mapping = reader->file.mapping;
+		img.mappingSize = reader->file.size;
+		reader->file.mapping = NULL;
+		reader->file.data = NULL;
+		reader_close(reader);
+		return img;
+	}
+
+	if (!allocate_image(&img, reader->width, reader->height)) {
+		reader_close(reader);
+		return empty_image();
+	}
+	if (reader->format == FORMAT_PPM_BINARY && reader->maxval == 255 && img.stride == (size_t) img.width) {
+		memcpy(img.pixels, reader->body, (size_t) img.width * (size_t) img.height * sizeof(Pixel));
+	} else if (reader->format != FORMAT_PPM_ASCII || !load_ppm_parallel(reader, &img, params.threads)) {
+		reader_read_rows(reader, &img, img.height);
+	}
+	reader_close(reader);
+	return img;
+}
+
+static bool load_ppm_parallel(RowReader *reader, Image *img, int threads) {
+	const unsigned char *begin = reader->body;
+	const unsigned char *end = reader->file.data + reader->file.size;
+	size_t length = (size_t) (end - begin);
+	// Comments can hide digits from the token counter, so those bodies take the sequential path.
+	if (threads < 2 || length < PARALLEL_MIN_BYTES || memchr(begin, '#', length) != NULL) {
+		return false;
+	}
+	if ((size_t) threads > length / (PARALLEL_MIN_BYTES / 4)) {
+		threads = (int) (length / (PARALLEL_MIN_BYTES / 4));
+	}
+	SampleChunk *chunks = calloc((size_t) threads, sizeof(SampleChunk));
+	if (chunks == NULL) {
+		return false;
+	}
+
+	// Chunk boundaries are moved forward to the next whitespace byte so no sample is split.
+	const unsigned char *start = begin;
+	for (int i = 0; i < threads; i++) {
+		const unsigned char *stop = i == threads - 1 ? end : begin + length / (size_t) threads * (size_t) (i + 1);
+		if (stop < start) {
+			stop = start;
+		}
+		while (stop < end && !(*stop == ' ' || (*stop >= '\t' && *stop <= '\r'))) {
+			stop++;
+		}
+		chunks[i] = (SampleChunk) {start, stop, img, reader->maxval, 0, 0, 0, false};
+		start = stop;
+	}
+	if (!run_parallel(chunks, sizeof(SampleChunk), threads, count_chunk)) {
+		free(chunks);
+		return false;
+	}
+
+	// Prefix sum of the counts; a chunk past an invalid byte contributes nothing, as the scan would stop there.
+	uint64_t total = (uint64_t) img->width * (uint64_t) img->height * sizeof(Pixel);
+	uint64_t first = 0;
+	bool stopped = false;
+	for (int i = 0; i < threads; i++) {
+		uint64_t count = stopped ? 0 : chunks[i].count;
+		chunks[i].first = first < total ? first : total;
+		chunks[i].limit = total - chunks[i].first < count ? total - chunks[i].first : count;
+		first += chunks[i].limit;
+		stopped = stopped || chunks[i].stopped;
+	}
+	bool ok = run_parallel(chunks, sizeof(SampleChunk), threads, decode_chunk);
+	free(chunks);
+	if (!ok) {
+		return false;
+	}
+
+	// Missing trailing samples are left black.
+	size_t rowSamples = (size_t) img->width * sizeof(Pixel);
+	for (uint64_t pos = first; pos < total;) {
+		size_t col = (size_t) (pos % rowSamples);
+		memset((unsigned char *) image_row(img, (int) (pos / rowSamples)) + col, 0, rowSamples - col);
+		pos += rowSamples - col;
+	}
+	return true;
+}
+
+static bool run_parallel(void *tasks, size_t taskSize, int count, void *(*worker)(void *)) {
+	pthread_t *ids = malloc((size_t) count * sizeof(pthread_t));
+	if (ids == NULL) {
+		return false;
+	}
+	unsigned char *task = tasks;
+	int started = 1;
+	while (started < count && pthread_create(&ids[started], NULL, worker, task + taskSize * (size_t) started) == 0) {
+		started++;
+	}
+	// The calling thread takes the first task; any task whose thread failed to start runs here too.
+	for (int i = started; i < count; i++) {
+		worker(task + taskSize * (size_t) i);
+	}
+	worker(task);
+	for (int i = 1; i < started; i++) {
+		pthread_join(ids[i], NULL);
+	}
+	free(ids);
+	return true;
+}
+
+static uint64_t count_samples(const unsigned char *p, const unsigned char *end, bool *stopped) {
+	uint64_t count = 0;
+	*stopped = false;
+	while (p < end) {
+		if ((unsigned) (*p - '0') <= 9) {
+			count++;
+			do {
+				p++;
+			} while (p < end && (unsigned) (*p - '0') <= 9);
+		} else if (*p == ' ' || (*p >= '\t' && *p <= '\r')) {
+			p++;
+		} else {
+			*stopped = true;
+			break;
+		}
+	}
+	return count;
+}
+
+static void *count_chunk(void *arg) {
+	SampleChunk *chunk = arg;
+	chunk->count = count_samples(chunk->begin, chunk->end, &chunk->stopped);
+	return NULL;
+}
+
+static void *decode_chunk(void *arg) {
+	SampleChunk *chunk = arg;
+	Scanner scanner = {chunk->begin, chunk->end};
+	size_t rowSamples = (size_t) chunk->img->width * sizeof(Pixel);
+	uint64_t pos = chunk->first;
+	uint64_t left = chunk->limit;
+	while (left > 0) {
+		size_t col = (size_t) (pos % rowSamples);
+		size_t n = rowSamples - col < left ? rowSamples - col : (size_t) left;
+		unsigned char *out = (unsigned char *) image_row(chunk->img, (int) (pos / rowSamples)) + col;
+		if (scan_samples(&scanner, out, out + n, chunk->maxval) != out + n) {
+			break;
+		}
+		pos += n;
+		left -= n;
+	}
+	return NULL;
+}
+
+static int parse_threads(const char *text) {
+	Scanner scanner = {(const unsigned char *) text, (const unsigned char *) text + strlen(text)};
+	unsigned value;
+	if (!scan_uint(&scanner, &value) || scanner.pos != scanner.end || value == 0 || value > MAX_THREADS) {
+		return 0;
+	}
+	return (int) value;
+}
+
+static ImageFormat output_format(const char *filepath, SaveParams params) {
+	const char *extension = params.type != NULL ? params.type : getExt(filepath);
+
+	if (strcmp(extension, "ppm") == 0) {
+		return params.binaryPpm ? FORMAT_PPM_BINARY : FORMAT_PPM_ASCII;
+	} else if (strcmp(extension, "sbu") == 0) {
+		return params.binarySbu ? FORMAT_SBU_BINARY : FORMAT_SBU;
+	}
+	return FORMAT_NONE;
+}
+
+static bool save_with_format(const Image *img, const char *filepath, ImageFormat format) {
+	return encode_image(img, filepath, format, NULL);
+}
+
+static bool encode_image(const Image *img, const char *filepath, ImageFormat format, OutputBuffer *memory) {
+	// Without a path the encoding is handed over in *memory, whose data the caller frees.
+	Palette palette = {NULL, 0, 0, NULL, 0};
+	if ((format == FORMAT_SBU || format == FORMAT_SBU_BINARY) && !build_palette(img, &palette)) {
+		return false;
+	}
+	RowWriter writer;
+	bool ok;
+	if (filepath != NULL) {
+		ok = writer_open(&writer, filepath, format, img->width, img->height, &palette);
+	} else {
+		ok = output_open_memory(&writer.out) && writer_begin(&writer, format, img->width, img->height, &palette);
+	}
+	if (ok) {
+		writer_write_rows(&writer, img, img->height);
+		ok = writer_close(&writer);
+	}
+	if (filepath == NULL) {
+		if (ok) {
+			*memory = writer.out;
+		} else {
+			free(writer.out.data);
+		}
+	}
+	palette_free(&palette);
+	return ok;
+}
+
+static bool output_writable(const char *filepath) {
+	// Checked without creating or truncating anything; the output is only opened once the result is ready.
+	if (strcmp(filepath, "-") == 0) {
+		return true;
+	}
+	struct stat st;
+	if (stat(filepath, &st) == 0) {
+		return !S_ISDIR(st.st_mode) && access(filepath, W_OK) == 0;
+	}
+	const char *slash = strrchr(filepath, '/');
+	if (slash == NULL) {
+		return access(".", W_OK | X_OK) == 0;
+	}
+	if (slash == filepath) {
+		return access("/", W_OK | X_OK) == 0;
+	}
+	char *directory = strndup(filepath, (size_t) (slash - filepath));
+	bool writable = directory != NULL && access(directory, W_OK | X_OK) == 0;
+	free(directory);
+	return writable;
+}
+
+static bool same_file(const char *input, const char *output) {
+	struct stat a, b;
+	if (strcmp(output, "-") == 0 || stat(output, &b) != 0 || !input_stat(input, &a)) {
+		return false;
+	}
+	return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+static bool input_stat(const char *filepath, struct stat *st) {
+	// An input of "-" is whatever stdin was redirected from, which can be the output file itself.
+	return strcmp(filepath, "-") == 0 ? fstat(STDIN_FILENO, st) == 0 : stat(filepath, st) == 0;
+}
+
+static bool output_open(OutputBuffer *out, const char *filepath) {
+	out->length = 0;
+	out->capacity = OUTPUT_BUFFER_SIZE;
+	out->failed = false;
+	out->fd = strcmp(filepath, "-") == 0 ? dup(STDOUT_FILENO) : open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out->fd == -1) {
+		out->data = NULL;
+		return false;
+	}
+	Scratch *scratch = workerScratch;
+	if (scratch != NULL && scratch->output != NULL) {
+		out->data = scratch->output;
+		scratch->output = NULL;
+	} else {
+		out->data = malloc(out->capacity);
+	}
+	if (out->data == NULL) {
+		close(out->fd);
+		return false;
+	}
+	return true;
+}
+
+static bool output_open_memory(OutputBuffer *out) {
+	// An in-memory output has no descriptor; instead of being flushed, its buffer grows.
+	out->fd = -1;
+	out->length = 0;
+	out->capacity = OUTPUT_BUFFER_SIZE;
+	out->failed = false;
+	out->data = malloc(out->capacity);
+	return out->data != NULL;
+}
+
+static void output_flush(OutputBuffer *out) {
+	if (out->fd == -1) {
+		unsigned char *grown = out->failed ? NULL : realloc(out->data, out->capacity * 2);
+		if (grown == NULL) {
+			// The result is lost either way; emptying the buffer keeps writers that need room moving.
+			out->failed = true;
+			out->length = 0;
+			return;
+		}
+		out->data = grown;
+		out->capacity *= 2;
+		return;
+	}
+	size_t written = 0;
+	while (!out->failed && written < out->length) {
+		ssize_t n = write(out->fd, out->data + written, out->length - written);
+		if (n <= 0) {
+			out->failed = true;
+			break;
+		}
+		written += (size_t) n;
+	}
+	out->length = 0;
+}
+
+static void output_write(OutputBuffer *out, const void *data, size_t length) {
+	if (out->capacity - out->length < length) {
+		output_flush(out);
+	}
+	while (out->fd == -1 && out->capacity - out->length < length) {
+		output_flush(out);
+		if (out->failed) {
+			return;
+		}
+	}
+	if (length >= out->capacity) {
+		// Large payloads (P6 rows) skip the staging buffer.
+		const unsigned char *bytes = data;
+		while (!out->failed && length > 0) {
+			ssize_t n = write(out->fd, bytes, length);
+			if (n <= 0) {
+				out->failed = true;
+				break;
+			}
+			bytes += n;
+			length -= (size_t) n;
+		}
+		return;
+	}
+	memcpy(out->data + out->length, data, length);
+	out->length += length;
+}
+
+static bool output_close(OutputBuffer *out) {
+	if (out->fd == -1) {
+		return !out->failed;
+	}
+	output_flush(out);
+	Scratch *scratch = workerScratch;
+	if (scratch != NULL && scratch->output == NULL) {
+		scratch->output = out->data;
+	} else {
+		free(out->data);
+	}
+	out->data = NULL;
+	if (close(out->fd) != 0) {
+		out->failed = true;
+	}
+	return !out->failed;
+}
+
+static void build_digit_table(DigitTable *table) {
+	// Every sample is written as its decimal digits followed by one space, exactly like "%hhu ".
+	for (int v = 0; v < 256; v++) {
+		unsigned char *text = table->text[v];
+		int n = 0;
+		if (v >= 100) text[n++] = (unsigned char) ('0' + v / 100);
+		if (v >= 10) text[n++] = (unsigned char) ('0' + v / 10 % 10);
+		text[n++] = (unsigned char) ('0' + v % 10);
+		text[n] = ' ';
+		while (n < 3) {
+			text[++n] = ' ';
+		}
+		table->length[v] = (unsigned char) (v >= 100 ? 4 : v >= 10 ? 3 : 2);
+	}
+}
+
+static void fill_pixels(Pixel *dst, Pixel color, size_t count) {
+	if (count == 0) {
+		return;
+	}
+	dst[0] = color;
+	size_t filled = 1;
+	while (filled < count) {
+		size_t n = filled < count - filled ? filled : count - filled;
+		memcpy(dst + filled, dst, n * sizeof(Pixel));
+		filled += n;
+	}
+}
+
+static bool cursor_fill(PixelCursor *cursor, Pixel color, uint64_t count) {
+	Image *img = cursor->img;
+	uint64_t remaining = (uint64_t) (img->height - cursor->row) * (uint64_t) img->width - (uint64_t) cursor->col;
+	if (count > remaining) {
+		return false;
+	}
+	if (count == 1) {
+		image_row(img, cursor->row)[cursor->col] = color;
+		if (++cursor->col == img->width) {
+			cursor->col = 0;
+			cursor->row++;
+		}
+		return true;
+	}
+
+	// Finish the current row, then fill one whole row and copy it into the rest.
+	size_t head = (size_t) img->width - (size_t) cursor->col;
+	if (count < head) {
+		head = (size_t) count;
+	}
+	fill_pixels(image_row(img, cursor->row) + cursor->col, color, head);
+	count -= head;
+	cursor->col += (int) head;
+	if (cursor->col == img->width) {
+		cursor->col = 0;
+		cursor->row++;
+	}
+
+	const Pixel *fullRow = NULL;
+	while (count >= (uint64_t) img->width && count > 0) {
+		Pixel *row = image_row(img, cursor->row);
+		if (fullRow == NULL) {
+			fill_pixels(row, color, (size_t) img->width);
+			fullRow = row;
+		} else {
+			memcpy(row, fullRow, (size_t) img->width * sizeof(Pixel));
+		}
+		count -= (uint64_t) img->width;
+		cursor->row++;
+	}
+	if (count > 0) {
+		Pixel *row = image_row(img, cursor->row);
+		if (fullRow != NULL) {
+			memcpy(row, fullRow, (size_t) count * sizeof(Pixel));
+		} else {
+			fill_pixels(row, color, (size_t) count);
+		}
+		cursor->col = (int) count;
+	}
+	return true;
+}
+
+static Image load_sbu_reader(RowReader *reader) {
+	Image img;
+	if ((reader->format != FORMAT_SBU && reader->format != FORMAT_SBU_BINARY) ||
+		!allocate_image(&img, reader->width, reader->height)) {
+		reader_close(reader);
+		return empty_image();
+	}
+	bool ok = reader_read_rows(reader, &img, img.height) && reader_finish(reader);
+	reader_close(reader);
+	if (!ok) {
+		free_image(img);
+		return empty_image();
+	}
+	return img;
+}
+
+static bool reader_open(RowReader *reader, const char *filepath) {
+	memset(reader, 0, sizeof(*reader));
+	bool mapped = strcmp(filepath, "-") == 0 ? map_descriptor(dup(STDIN_FILENO), &reader->file)
+											 : map_file(filepath, &reader->file);
+	return mapped && reader_parse(reader);
+}
+
+static bool reader_open_memory(RowReader *reader, const void *data, size_t size) {
+	// The reader keeps its own copy, so the caller's buffer may go away as soon as this returns.
+	memset(reader, 0, sizeof(*reader));
+	unsigned char *copy = malloc(size > 0 ? size : 1);
+	if (copy == NULL) {
+		return false;
+	}
+	memcpy(copy, data, size);
+	reader->file = (FileData) {copy, size, NULL};
+	return reader_parse(reader);
+}
+
+static bool reader_parse(RowReader *reader) {
+
+	Scanner scanner = {reader->file.data, reader->file.data + reader->file.size};
+	unsigned width, height;
+	if (reader->file.size >= 4 && memcmp(reader->file.data, SBU_BINARY_MAGIC, 4) == 0) {
+		scanner.pos += 4;
+		uint64_t width64, height64, numColors;
+		if (!read_varint(&scanner, &width64) || !read_varint(&scanner, &height64) ||
+			!read_varint(&scanner, &numColors) || width64 > INT32_MAX || height64 > INT32_MAX ||
+			numColors > 1u << 24 || (size_t) (scanner.end - scanner.pos) / sizeof(Pixel) < numColors) {
+			reader_close(reader);
+			return false;
+		}
+		width = (unsigned) width64;
+		height = (unsigned) height64;
+		reader->format = FORMAT_SBU_BINARY;
+		reader->numColors = (uint32_t) numColors;
+		reader->indexBytes = sbu_index_bytes((int) numColors);
+		reader->palette = (const Pixel *) scanner.pos;
+		scanner.pos += numColors * sizeof(Pixel);
+	} else if (scan_word(&scanner, "SBU")) {
+		unsigned numColors;
+		if (!scan_uint(&scanner, &width) || !scan_uint(&scanner, &height) || !scan_uint(&scanner, &numColors) ||
+			width > INT32_MAX || height > INT32_MAX || numColors > (size_t) (scanner.end - scanner.pos + 1) / 6) {
+			reader_close(reader);
+			return false;
+		}
+		// The palette size comes from the file, so it must not be trusted with a stack array.
+		reader->ownedPalette = malloc((numColors > 0 ? numColors : 1) * sizeof(Pixel));
+		if (reader->ownedPalette == NULL) {
+			reader_close(reader);
+			return false;
+		}
+		for (unsigned i = 0; i < numColors; i++) {
+			unsigned r, g, b;
+			if (!scan_uint(&scanner, &r) || !scan_uint(&scanner, &g) || !scan_uint(&scanner, &b) || r > 255 ||
+				g > 255 || b > 255) {
+				reader_close(reader);
+				return false;
+			}
+			reader->ownedPalette[i] = (Pixel) {(unsigned char) r, (unsigned char) g, (unsigned char) b};
+		}
+		reader->format = FORMAT_SBU;
+		reader->numColors = numColors;
+		reader->palette = reader->ownedPalette;
+	} else {
+		bool binary;
+		if (!parse_ppm_header(&scanner, &width, &height, &reader->maxval, &binary)) {
+			reader_close(reader);
+			return false;
+		}
+		reader->format = binary ? FORMAT_PPM_BINARY : FORMAT_PPM_ASCII;
+		size_t rowBytes = (size_t) width * sizeof(Pixel) * (reader->maxval < 256 ? 1 : 2);
+		if (binary && rowBytes != 0 && (size_t) (scanner.end - scanner.pos) / rowBytes < height) {
+			reader_close(reader);
+			return false;
+		}
+	}
+
+	reader->width = (int) width;
+	reader->height = (int) height;
+	reader->body = scanner.pos;
+	reader->scanner = scanner;
+	reader_rewind(reader);
+	return true;
+}
+
+static void reader_rewind(RowReader *reader) {
+	reader->scanner.pos = reader->body;
+	reader->nextRow = 0;
+	reader->pixelsLeft = (uint64_t) reader->width * (uint64_t) reader->height;
+	reader->pendingRun = 0;
+	reader->released = 0;
+	reader->failed = false;
+}
+
+static bool reader_next_run(RowReader *reader) {
+	Scanner *scanner = &reader->scanner;
+	uint64_t run = 1;
+	uint32_t index;
+	if (reader->format == FORMAT_SBU_BINARY) {
+		if (scanner->pos == scanner->end) {
+			return false;
+		}
+		if (!read_varint(scanner, &run) || scanner->end - scanner->pos < reader->indexBytes) {
+			reader->failed = true;
+			return false;
+		}
+		index = scanner->pos[0];
+		if (reader->indexBytes > 1) index |= (uint32_t) scanner->pos[1] << 8;
+		if (reader->indexBytes > 2) index |= (uint32_t) scanner->pos[2] << 16;
+		scanner->pos += reader->indexBytes;
+	} else {
+		scanner_skip_space(scanner);
+		if (scanner->pos == scanner->end) {
+			return false;
+		}
+		unsigned value;
+		if (*scanner->pos == '*') {
+			scanner->pos++;
+			if (!scan_u64(scanner, &run)) {
+				reader->failed = true;
+				return false;
+			}
+		}
+		if (!scan_uint(scanner, &value)) {
+			reader->failed = true;
+			return false;
+		}
+		index = value;
+	}
+	// A run that would pass the last pixel, or a colour outside the palette, makes the whole stream invalid.
+	if (index >= reader->numColors || run > reader->pixelsLeft) {
+		reader->failed = true;
+		return false;
+	}
+	reader->pixelsLeft -= run;
+	reader->pendingRun = run;
+	reader->pendingColor = reader->palette[index];
+	return true;
+}
+
+static bool reader_read_rows(RowReader *reader, Image *band, int rows) {
+	if (reader->failed) {
+		return false;
+	}
+	if (rows > reader->height - reader->nextRow) {
+		rows = reader->height - reader->nextRow;
+	}
+	size_t rowBytes = (size_t) reader->width * sizeof(Pixel);
+
+	if (reader->format == FORMAT_PPM_ASCII) {
+		// Missing trailing samples are left black, as the fscanf loader did.
+		for (int i = 0; i < rows; i++) {
+			unsigned char *out = (unsigned char *) image_row(band, i);
+			unsigned char *rowEnd = out + rowBytes;
+			out = scan_samples(&reader->scanner, out, rowEnd, reader->maxval);
+			memset(out, 0, (size_t) (rowEnd - out));
+			reader_release(reader);
+		}
+	} else if (reader->format == FORMAT_PPM_BINARY) {
+		size_t sampleBytes = reader->maxval < 256 ? 1 : 2;
+		const unsigned char *in = reader->body + rowBytes * sampleBytes * (size_t) reader->nextRow;
+		for (int i = 0; i < rows; i++, in += rowBytes * sampleBytes) {
+			unsigned char *out = (unsigned char *) image_row(band, i);
+			if (reader->maxval == 255) {
+				memcpy(out, in, rowBytes);
+			} else if (sampleBytes == 1) {
+				for (size_t k = 0; k < rowBytes; k++) {
+					out[k] = scale_sample(in[k], reader->maxval);
+				}
+			} else {
+				for (size_t k = 0; k < rowBytes; k++) {
+					out[k] = scale_sample((unsigned) in[2 * k] << 8 | in[2 * k + 1], reader->maxval);
+				}
+			}
+			reader->scanner.pos = in + rowBytes * sampleBytes;
+			reader_release(reader);
+		}
+	} else {
+		// Runs are not aligned to rows, so one may be split across bands; the remainder stays pending.
+		PixelCursor cursor = {band, 0, 0};
+		uint64_t space = (uint64_t) rows * (uint64_t) reader->width;
+		while (space > 0) {
+			if (reader->pendingRun == 0 && !reader_next_run(reader)) {
+				if (reader->failed) {
+					return false;
+				}
+				Pixel black = {0, 0, 0};
+				cursor_fill(&cursor, black, space);
+				break;
+			}
+			uint64_t n = reader->pendingRun < space ? reader->pendingRun : space;
+			cursor_fill(&cursor, reader->pendingColor, n);
+			reader->pendingRun -= n;
+			space -= n;
+			reader_release(reader);
+		}
+	}
+	reader->nextRow += rows;
+	reader_release(reader);
+	return true;
+}
+
+static void reader_release(RowReader *reader) {
+	// Give back input pages already decoded, in 1 MiB steps, so the mapping does not grow the resident set.
+	if (!reader->dropConsumed || reader->file.mapping == NULL) {
+		return;
+	}
+	size_t consumed = (size_t) (reader->scanner.pos - reader->file.data) & ~(size_t) (READER_RELEASE_STEP - 1);
+	if (consumed >= reader->released + READER_RELEASE_STEP) {
+		madvise((unsigned char *) reader->file.mapping + reader->released, consumed - reader->released,
+				MADV_DONTNEED);
+		reader->released = consumed;
+	}
+}
+
+static bool reader_finish(RowReader *reader) {
+	if (reader->format == FORMAT_SBU || reader->format == FORMAT_SBU_BINARY) {
+		while (!reader->failed && (reader->pendingRun == 0 || reader->pixelsLeft > 0)) {
+			reader->pendingRun = 0;
+			if (!reader_next_run(reader)) {
+				break;
+			}
+		}
+	}
+	return !reader->failed;
+}
+
+static void reader_close(RowReader *reader) {
+	free(reader->ownedPalette);
+	reader->ownedPalette = NULL;
+	reader->palette = NULL;
+	unmap_file(&reader->file);
+}
+
+static bool writer_open(RowWriter *writer, const char *filepath, ImageFormat format, int width, int height,
+				 const Palette *palette) {
+	if (!output_open(&writer->out, filepath)) {
+		return false;
+	}
+	return writer_begin(writer, format, width, height, palette);
+}
+
+static bool writer_begin(RowWriter *writer, ImageFormat format, int width, int height, const Palette *palette) {
+	writer->format = format;
+	writer->palette = palette;
+	writer->indexBytes = 0;
+	writer->runLength = 0;
+
+	char header[64];
+	int headerLength;
+	switch (format) {
+		case FORMAT_PPM_ASCII:
+		case FORMAT_PPM_BINARY:
+			headerLength = snprintf(header, sizeof(header), "%s\n%d %d\n255\n",
+									format == FORMAT_PPM_BINARY ? "P6" : "P3", width, height);
+			output_write(&writer->out, header, (size_t) headerLength);
+			build_digit_table(&writer->table);
+			break;
+		case FORMAT_SBU:
+			headerLength = snprintf(header, sizeof(header), "SBU\n%d %d\n", width, height);
+			output_write(&writer->out, header, (size_t) headerLength);
+			output_uint(&writer->out, (uint64_t) palette->count, ' ');
+			build_digit_table(&writer->table);
+			for (int i = 0; i < palette->count; i++) {
+				const unsigned char *sample = (const unsigned char *) &palette->colors[i];
+				for (size_t k = 0; k < sizeof(Pixel); k++) {
+					output_write(&writer->out, writer->table.text[sample[k]], writer->table.length[sample[k]]);
+				}
+			}
+			output_write(&writer->out, "\n", 1);
+			break;
+		case FORMAT_SBU_BINARY:
+			writer->indexBytes = sbu_index_bytes(palette->count);
+			output_write(&writer->out, SBU_BINARY_MAGIC, 4);
+			output_varint(&writer->out, (uint64_t) width);
+			output_varint(&writer->out, (uint64_t) height);
+			output_varint(&writer->out, (uint64_t) palette->count);
+			output_write(&writer->out, palette->colors, (size_t) palette->count * sizeof(Pixel));
+			break;
+		default:
+			output_close(&writer->out);
+			return false;
+	}
+	return true;
+}
+
+static void writer_write_rows(RowWriter *writer, const Image *band, int rows) {
+	OutputBuffer *out = &writer->out;
+	if (writer->format == FORMAT_PPM_BINARY) {
+		for (int i = 0; i < rows; i++) {
+			output_write(out, image_row(band, i), (size_t) band->width * sizeof(Pixel));
+		}
+		return;
+	}
+
+	if (writer->format == FORMAT_PPM_ASCII) {
+		// Worst case per pixel is "255 255 255 ", so a row chunk of this many pixels always fits.
+		const size_t maxPixelBytes = 12;
+		for (int i = 0; i < rows; i++) {
+			const unsigned char *sample = (const unsigned char *) image_row(band, i);
+			const unsigned char *rowEnd = sample + (size_t) band->width * sizeof(Pixel);
+			while (sample < rowEnd) {
+				if (out->capacity - out->length < maxPixelBytes + 1) {
+					output_flush(out);
+				}
+				size_t room = (out->capacity - out->length - 1) / maxPixelBytes * sizeof(Pixel);
+				const unsigned char *chunkEnd = (size_t) (rowEnd - sample) < room ? rowEnd : sample + room;
+				unsigned char *dst = out->data + out->length;
+				while (sample < chunkEnd) {
+					unsigned char v = *sample++;
+					memcpy(dst, writer->table.text[v], 4);
+					dst += writer->table.length[v];
+				}
+				out->length = (size_t) (dst - out->data);
+			}
+			if (out->length == out->capacity) {
+				output_flush(out);
+			}
+			out->data[out->length++] = '\n';
+		}
+		return;
+	}
+
+	// Runs may continue across row ends (and band ends), so the open run is carried in the writer.
+	for (int i = 0; i < rows; i++) {
+		const Pixel *row = image_row(band, i);
+		for (int j = 0; j < band->width; j++) {
+			if (writer->runLength > 0 && pixel_equal(row[j], writer->current)) {
+				writer->runLength++;
+				continue;
+			}
+			if (writer->runLength > 0) {
+				emit_sbu_run(out, writer->runLength, palette_find(writer->palette, writer->current),
+							 writer->indexBytes);
+			}
+			writer->current = row[j];
+			writer->runLength = 1;
+		}
+	}
+}
+
+static bool writer_close(RowWriter *writer) {
+	if ((writer->format == FORMAT_SBU || writer->format == FORMAT_SBU_BINARY) && writer->runLength > 0) {
+		emit_sbu_run(&writer->out, writer->runLength, palette_find(writer->palette, writer->current),
+					 writer->indexBytes);
+		writer->runLength = 0;
+	}
+	return output_close(&writer->out);
+}
+
+static bool parse_size(const char *text, uint64_t *bytes) {
+	Scanner scanner = {(const unsigned char *) text, (const unsigned char *) text + strlen(text)};
+	uint64_t value;
+	if (!scan_u64(&scanner, &value)) {
+		return false;
+	}
+	unsigned shift = 0;
+	if (scanner.pos < scanner.end) {
+		switch (toupper(*scanner.pos++)) {
+			case 'K': shift = 10; break;
+			case 'M': shift = 20; break;
+			case 'G': shift = 30; break;
+			default: return false;
+		}
+	}
+	if (scanner.pos != scanner.end || value > UINT64_MAX >> shift) {
+		return false;
+	}
+	*bytes = value << shift;
+	return true;
+}
+
+static int stream_image(const char *inputPath, const char *outputPath, ImageFormat format, const CopyParams *copy,
+				 const PasteParams *paste, const RenderParams *render, uint64_t maxMemory) {
+	if (format == FORMAT_NONE) {
+		return UNRECOGNIZED_ARGUMENT;
+	}
+	RowReader reader;
+	if (!reader_open(&reader, inputPath)) {
+		return INPUT_FILE_MISSING;
+	}
+	reader.dropConsumed = true;
+	int width = reader.width;
+	int height = reader.height;
+
+	Font *font = NULL;
+	MessageLayout layout = {NULL, 0, NULL, 0, 0, 0, 0, 0, 0};
+	if (render != NULL) {
+		font = load_render_font(render->fontPath);
+		if (font == NULL || !message_supported(font, render->message, true) ||
+			!layout_message(font, *render, width, height, &layout)) {
+			if (font != NULL) {
+				free_render_font(font);
+			}
+			reader_close(&reader);
+			return MISSING_ARGUMENT;
+		}
+	}
+
+	// Only the copied rectangle is buffered; everything else flows through one band of rows.
+	CopyParams region = {0, 0, 0, 0};
+	bool pasting = copy != NULL && paste != NULL && clip_copy_region(width, height, *copy, *paste, &region);
+	Image regionPixels = empty_image();
+	uint64_t rowBytes = (uint64_t) image_stride(width) * sizeof(Pixel);
+	uint64_t fixedBytes = OUTPUT_BUFFER_SIZE;
+	if (pasting) {
+		fixedBytes += (uint64_t) image_stride(region.width) * (uint64_t) region.height * sizeof(Pixel);
+	}
+	if (maxMemory < fixedBytes + rowBytes) {
+		// The budget must hold the output buffer, the copied region and at least one row of the band.
+		if (font != NULL) {
+			free_layout(&layout);
+			free_render_font(font);
+		}
+		reader_close(&reader);
+		return UNRECOGNIZED_ARGUMENT;
+	}
+	uint64_t bandRows64 = rowBytes > 0 ? (maxMemory - fixedBytes) / rowBytes : 1;
+	int bandRows = bandRows64 > (uint64_t) height ? height : (int) bandRows64;
+
+	// Decoding failures are input errors; allocation and output failures override that below.
+	int result = 0;
+	Image band = empty_image();
+	bool ok = allocate_image(&band, width, bandRows > 0 ? bandRows : 1);
+	if (ok && pasting) {
+		ok = allocate_image(&regionPixels, region.width, region.height);
+	}
+	if (!ok) {
+		result = MISSING_ARGUMENT;
+	}
+	if (ok && pasting) {
+		int lastSourceRow = region.row + region.height;
+		for (int y = 0; ok && y < lastSourceRow; y += bandRows) {
+			int rows = bandRows < height - y ? bandRows : height - y;
+			ok = reader_read_rows(&reader, &band, rows);
+			for (int r = y > region.row ? y : region.row; ok && r < y + rows && r < lastSourceRow; r++) {
+				memcpy(image_row(&regionPixels, r - region.row), image_row(&band, r - y) + region.column,
+					   (size_t) region.width * sizeof(Pixel));
+			}
+		}
+		reader_rewind(&reader);
+	}
+
+	// SBU needs its palette before the first run, so that format makes one extra pass to collect it.
+	bool sbu = format == FORMAT_SBU || format == FORMAT_SBU_BINARY;
+	Palette palette = {NULL, 0, 0, NULL, 0};
+	if (ok && sbu && !palette_init(&palette)) {
+		ok = false;
+		result = MISSING_ARGUMENT;
+	}
+	RowWriter writer;
+	bool writing = false;
+	for (int pass = sbu ? 0 : 1; ok && pass < 2; pass++) {
+		if (pass == 1) {
+			writing = writer_open(&writer, outputPath, format, width, height, &palette);
+			ok = writing;
+			if (!writing) {
+				result = OUTPUT_FILE_UNWRITABLE;
+			}
+		}
+		for (int y = 0; ok && y < height; y += bandRows) {
+			int rows = bandRows < height - y ? bandRows : height - y;
+			ok = reader_read_rows(&reader, &band, rows);
+			Image view = band;
+			view.height = rows;
+			if (pasting) {
+				int first = y > paste->row ? y : paste->row;
+				for (int r = first; r < y + rows && r < paste->row + region.height; r++) {
+					memcpy(image_row(&view, r - y) + paste->column, image_row(&regionPixels, r - paste->row),
+						   (size_t) region.width * sizeof(Pixel));
+				}
+			}
+			if (font != NULL) {
+				draw_layout(&view, y, &layout, 1);
+			}
+			if (pass == 0) {
+				if (ok && !palette_add_image(&palette, &view)) {
+					ok = false;
+					result = MISSING_ARGUMENT;
+				}
+			} else if (ok) {
+				writer_write_rows(&writer, &view, rows);
+			}
+		}
+		ok = ok && reader_finish(&reader);
+		reader_rewind(&reader);
+	}
+	if (!ok && result == 0) {
+		result = INPUT_FILE_MISSING;
+	}
+	if (writing && !writer_close(&writer) && result == 0) {
+		result = OUTPUT_FILE_UNWRITABLE;
+	}
+	if (writing && result != 0 && strcmp(outputPath, "-") != 0) {
+		// Nothing is left behind for a failed job; the output was truncated when it was opened anyway.
+		unlink(outputPath);
+	}
+
+	palette_free(&palette);
+	free_image(regionPixels);
+	free_image(band);
+	if (font != NULL) {
+		free_layout(&layout);
+		free_render_font(font);
+	}
+	reader_close(&reader);
+	return result;
+}
+
+static bool build_palette(const Image *img, Palette *palette) {
+	if (!palette_init(palette)) {
+		return false;
+	}
+	if (!palette_add_image(palette, img)) {
+		palette_free(palette);
+		return false;
+	}
+	return true;
+}
+
+static bool palette_add_image(Palette *palette, const Image *img) {
+	for (int i = 0; i < img->height; i++) {
+		const Pixel *row = image_row(img, i);
+		for (int j = 0; j < img->width; j++) {
+			// Neighbouring pixels usually repeat, so skip the hash probe for them.
+			if (j > 0 && pixel_equal(row[j], row[j - 1])) {
+				continue;
+			}
+			if (palette_insert(palette, row[j]) < 0) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static int sbu_index_bytes(int numColors) {
+	return numColors <= 1 << 8 ? 1 : numColors <= 1 << 16 ? 2 : 3;
+}
+
+static void emit_sbu_run(OutputBuffer *out, uint64_t runLength, int index, int indexBytes) {
+	if (indexBytes > 0) {
+		unsigned char bytes[3] = {(unsigned char) index, (unsigned char) (index >> 8), (unsigned char) (index >> 16)};
+		output_varint(out, runLength);
+		output_write(out, bytes, (size_t) indexBytes);
+		return;
+	}
+	if (runLength == 1) {
+		output_uint(out, (uint64_t) index, ' ');
+	} else {
+		output_write(out, "*", 1);
+		output_uint(out, runLength, ' ');
+		output_uint(out, (uint64_t) index, ' ');
+	}
+}
+
+static void output_varint(OutputBuffer *out, uint64_t value) {
+	unsigned char bytes[10];
+	size_t n = 0;
+	while (value >= 0x80) {
+		bytes[n++] = (unsigned char) (value | 0x80);
+		value >>= 7;
+	}
+	bytes[n++] = (unsigned char) value;
+	output_write(out, bytes, n);
+}
+
+static bool read_varint(Scanner *scanner, uint64_t *value) {
+	uint64_t v = 0;
+	for (unsigned shift = 0; shift < 64 && scanner->pos < scanner->end; shift += 7) {
+		unsigned char byte = *scanner->pos++;
+		v |= (uint64_t) (byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			*value = v;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void output_uint(OutputBuffer *out, uint64_t value, char suffix) {
+	char text[24];
+	char *p = text + sizeof(text);
+	*--p = suffix;
+	do {
+		*--p = (char) ('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	output_write(out, p, (size_t) (text + sizeof(text) - p));
+}
+
+static bool palette_init(Palette *palette) {
+	palette->count = 0;
+	palette->capacity = 256;
+	palette->mask = 1023;
+	palette->colors = malloc((size_t) palette->capacity * sizeof(Pixel));
+	palette->slots = calloc(palette->mask + 1, sizeof(uint64_t));
+	if (palette->colors == NULL || palette->slots == NULL) {
+		palette_free(palette);
+		return false;
+	}
+	return true;
+}
+
+static inline size_t palette_hash(uint32_t rgb, size_t mask) {
+	return (size_t) (((uint64_t) rgb * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+static int palette_insert(Palette *palette, Pixel color) {
+	// A slot holds (index << 32) | rgb | 1 << 24; the marker bit keeps black distinct from an empty slot.
+	uint32_t key = pack_rgb(color) | 1u << 24;
+	size_t slot = palette_hash(key, palette->mask);
+	while (palette->slots[slot] != 0) {
+		if ((uint32_t) palette->slots[slot] == key) {
+			return (int) (palette->slots[slot] >> 32);
+		}
+		slot = (slot + 1) & palette->mask;
+	}
+
+	if (palette->count == palette->capacity) {
+		Pixel *colors = reallocarray(palette->colors, (size_t) palette->capacity * 2, sizeof(Pixel));
+		if (colors == NULL) {
+			return -1;
+		}
+		palette->colors = colors;
+		palette->capacity *= 2;
+	}
+	int index = palette->count++;
+	palette->colors[index] = color;
+	palette->slots[slot] = (uint64_t) index << 32 | key;
+
+	// Keep the table at most half full; rehash into twice the slots when it gets there.
+	if ((size_t) palette->count * 2 > palette->mask) {
+		size_t mask = palette->mask * 2 + 1;
+		uint64_t *slots = calloc(mask + 1, sizeof(uint64_t));
+		if (slots == NULL) {
+			return -1;
+		}
+		for (size_t k = 0; k <= palette->mask; k++) {
+			if (palette->slots[k] != 0) {
+				size_t s = palette_hash((uint32_t) palette->slots[k], mask);
+				while (slots[s] != 0) {
+					s = (s + 1) & mask;
+				}
+				slots[s] = palette->slots[k];
+			}
+		}
+		free(palette->slots);
+		palette->slots = slots;
+		palette->mask = mask;
+	}
+	return index;
+}
+
+static int palette_find(const Palette *palette, Pixel color) {
+	uint32_t key = pack_rgb(color) | 1u << 24;
+	size_t slot = palette_hash(key, palette->mask);
+	while (palette->slots[slot] != 0) {
+		if ((uint32_t) palette->slots[slot] == key) {
+			return (int) (palette->slots[slot] >> 32);
+		}
+		slot = (slot + 1) & palette->mask;
+	}
+	return -1;
+}
+
+static void palette_free(Palette *palette) {
+	free(palette->colors);
+	free(palette->slots);
+	palette->colors = NULL;
+	palette->slots = NULL;
+	palette->count = 0;
+}
+
+static char **loadFontsRaw(const char *filename) {
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		return NULL;
+	}
+
+	char **fonts = NULL;
+	size_t rowsAllocated = 0;
+	size_t currentRowLength = 0;
+	size_t rows = 0;
+	int ch;
+	char *lineBuffer = NULL;
+	size_t lineBufferSize = 0;
+
+	while ((ch = fgetc(file)) != EOF) {
+		if (ch == '\n' || ch == '\r') {
+			if (rows == rowsAllocated) {
+				size_t newSize = rowsAllocated == 0 ? 1 : rowsAllocated * 2;
+				char **newFonts = realloc(fonts, newSize * sizeof(char *));
+				if (!newFonts) {
+					fclose(file);
+					return NULL;
+				}
+
+				if (newSize > rowsAllocated) {
+					for (size_t i = rowsAllocated; i < newSize; i++) {
+						newFonts[i] = NULL;
+					}
+				}
+
+				fonts = newFonts;
+				rowsAllocated = newSize;
+			}
+			lineBuffer = realloc(lineBuffer, currentRowLength + 1);
+			lineBuffer[currentRowLength] = '\0';
+			fonts[rows++] = lineBuffer;
+			lineBuffer = NULL;
+			lineBufferSize = 0;
+			currentRowLength = 0;
+		} else {
+			if (currentRowLength == lineBufferSize) {
+				size_t newSize = lineBufferSize == 0 ? 1 : lineBufferSize * 2;
+				char *newLineBuffer = realloc(lineBuffer, newSize);
+				if (!newLineBuffer) {
+					fclose(file);
+					return NULL;
+				}
+				lineBuffer = newLineBuffer;
+				lineBufferSize = newSize;
+			}
+			lineBuffer[currentRowLength++] = (char) ch;
+		}
+	}
+	if (currentRowLength > 0) {
+		lineBuffer = realloc(lineBuffer, currentRowLength + 1);
+		lineBuffer[currentRowLength] = '\0';
+		if (rows == rowsAllocated) {
+			char **newFonts = realloc(fonts, (rowsAllocated + 1) * sizeof(char *));
+			if (!newFonts) {
+				fclose(file);
+				return NULL;
+			}
+			fonts = newFonts;
+		}
+		fonts[rows++] = lineBuffer;
+	} 
+	else if (lineBuffer != NULL) {
+		free(lineBuffer);
+	}
+
+	fclose(file);
+	// Callers walk the rows up to a NULL entry, which the growth above does not always leave.
+	char **terminated = realloc(fonts, (rows + 1) * sizeof(char *));
+	if (!terminated) {
+		for (size_t i = 0; i < rows; i++) {
+			free(fonts[i]);
+		}
+		free(fonts);
+		return NULL;
+	}
+	terminated[rows] = NULL;
+	return terminated;
+}
+
+static bool *columnOccupancy(char **rawFont, size_t *width) {
+	// One pass over the raw rows; a column is empty only if no row has anything but a space there,
+	// and columns past the end of a short row count as spaces.
+	*width = 0;
+	for (size_t i = 0; rawFont[i] != NULL; i++) {
+		size_t length = strlen(rawFont[i]);
+		if (length > *width) {
+			*width = length;
+		}
+	}
+	bool *occupied = calloc(*width + 1, sizeof(bool));
+	if (occupied == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; rawFont[i] != NULL; i++) {
+		for (size_t j = 0; rawFont[i][j] != '\0'; j++) {
+			if (rawFont[i][j] != ' ') {
+				occupied[j] = true;
+			}
+		}
+	}
+	return occupied;
+}
+
+static void freeFontsRaw(char **fonts) {
+	if (!fonts) {
+		return;
+	}
+
+	for (int i = 0; fonts[i] != NULL; i++) {
+		free(fonts[i]);
+	}
+
+	free(fonts);
+}
+
+static void initFont(Font *font, int numChars) {
+	font->numChars = numChars;
+	font->characters = (FontChar *) calloc(numChars > 0 ? numChars : 1, sizeof(FontChar));
+	font->file = (FileData) {NULL, 0, NULL};
+	memset(font->index, 0, sizeof(font->index));
+	font->numScaled = 0;
+	pthread_mutex_init(&font->scaledLock, NULL);
+	font->users = 1;
+}
+
+static bool addFontChar(Font *font, char key, const uint64_t *bits, int wordsPerRow, int rows, int cols, int index) {
+	if (index >= font->numChars) return false;
+
+	font->characters[index].key = key;
+	font->characters[index].rows = rows;
+	font->characters[index].cols = cols;
+	font->characters[index].bits = bits;
+	font->characters[index].wordsPerRow = wordsPerRow;
+	if (font->index[(unsigned char) key] == NULL) {
+		font->index[(unsigned char) key] = &font->characters[index];
+	}
+	return buildGlyphRuns(&font->characters[index]);
+}
+
+static bool buildGlyphRuns(FontChar *fontChar) {
+	// Each glyph row is stored as the runs of its set bits, so drawing a row is one span fill per run.
+	int maxRuns = fontChar->rows * ((fontChar->cols + 1) / 2);
+	fontChar->runs = malloc((maxRuns > 0 ? maxRuns : 1) * sizeof(GlyphRun));
+	fontChar->rowRuns = malloc((fontChar->rows + 1) * sizeof(int));
+	if (fontChar->runs == NULL || fontChar->rowRuns == NULL) {
+		return false;
+	}
+	int count = 0;
+	for (int j = 0; j < fontChar->rows; j++) {
+		const uint64_t *row = fontChar->bits + (size_t) j * fontChar->wordsPerRow;
+		fontChar->rowRuns[j] = count;
+		int k = glyphScan(row, 0, fontChar->cols, true);
+		while (k < fontChar->cols) {
+			int end = glyphScan(row, k, fontChar->cols, false);
+			fontChar->runs[count++] = (GlyphRun) {k, end - k};
+			k = glyphScan(row, end, fontChar->cols, true);
+		}
+	}
+	fontChar->rowRuns[fontChar->rows] = count;
+
+	// Ink bounding box in cells, half-open; a glyph without ink has inkTop == inkBottom.
+	GlyphMetrics *metrics = &fontChar->metrics;
+	*metrics = (GlyphMetrics) {0, 0, fontChar->cols, 0, fontChar->cols};
+	for (int j = 0; j < fontChar->rows; j++) {
+		int first = fontChar->rowRuns[j];
+		int last = fontChar->rowRuns[j + 1];
+		if (first == last) {
+			continue;
+		}
+		if (metrics->inkTop == metrics->inkBottom) {
+			metrics->inkTop = j;
+		}
+		metrics->inkBottom = j + 1;
+		if (fontChar->runs[first].start < metrics->inkLeft) {
+			metrics->inkLeft = fontChar->runs[first].start;
+		}
+		if (fontChar->runs[last - 1].start + fontChar->runs[last - 1].length > metrics->inkRight) {
+			metrics->inkRight = fontChar->runs[last - 1].start + fontChar->runs[last - 1].length;
+		}
+	}
+	if (metrics->inkTop == metrics->inkBottom) {
+		metrics->inkLeft = metrics->inkRight = 0;
+	}
+	return true;
+}
+
+static int glyphScan(const uint64_t *row, int from, int limit, bool set) {
+	// Index of the first bit at or after `from` that equals `set`, or `limit` if there is none.
+	while (from < limit) {
+		uint64_t word = set ? row[from / 64] : ~row[from / 64];
+		word &= ~(uint64_t) 0 << (from % 64);
+		if (word != 0) {
+			int bit = from / 64 * 64 + __builtin_ctzll(word);
+			return bit < limit ? bit : limit;
+		}
+		from = (from / 64 + 1) * 64;
+	}
+	return limit;
+}
+
+static void freeFont(Font *font) {
+	for (int s = 0; s < font->numScaled; s++) {
+		for (int i = 0; i < font->numChars; i++) {
+			free(font->scaled[s].glyphs[i]);
+		}
+		free(font->scaled[s].glyphs);
+	}
+	pthread_mutex_destroy(&font->scaledLock);
+	for (int i = 0; i < font->numChars; i++) {
+		freeFontChar(font, i);
+	}
+	free(font->characters);
+	unmap_file(&font->file);
+}
+
+static void freeFontChar(const Font *font, int i) {
+	// Runs of a compiled font point into its mapping and it has no bits; only text fonts own them.
+	if (font->file.data == NULL) {
+		free((void *) font->characters[i].bits);
+		free(font->characters[i].runs);
+		free(font->characters[i].rowRuns);
+	}
+}
+
+static Font *loadFont(char **rawFont) {
+	// An optional "#!keys" first line names the glyphs in order; without it they are A to Z.
+	const char *keys = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	char *keyLine = NULL;
+	if (rawFont[0] != NULL && strncmp(rawFont[0], FONT_KEYS_PREFIX, strlen(FONT_KEYS_PREFIX)) == 0) {
+		keyLine = fontKeys(rawFont[0] + strlen(FONT_KEYS_PREFIX));
+		if (keyLine == NULL) {
+			return NULL;
+		}
+		keys = keyLine;
+		rawFont++;
+	}
+	size_t width;
+	bool *occupied = columnOccupancy(rawFont, &width);
+	if (occupied == NULL) {
+		free(keyLine);
+		return NULL;
+	}
+	int rows = 0;
+	while (rawFont[rows] != NULL) {
+		rows++;
+	}
+	size_t *lengths = malloc((rows > 0 ? rows : 1) * sizeof(size_t));
+	if (lengths == NULL) {
+		free(occupied);
+		free(keyLine);
+		return NULL;
+	}
+	for (int j = 0; j < rows; j++) {
+		lengths[j] = strlen(rawFont[j]);
+	}
+
+	// Glyphs are the maximal runs of occupied columns; glyphs beyond the last key are dropped.
+	int maxChars = (int) strlen(keys);
+	int numChars = 0;
+	for (size_t j = 0; j < width; j++) {
+		if (occupied[j] && (j == 0 || !occupied[j - 1])) {
+			numChars++;
+		}
+	}
+	if (numChars > maxChars) {
+		numChars = maxChars;
+	}
+
+	Font *font = (Font *) malloc(sizeof(Font));
+	initFont(font, numChars);
+
+	bool ok = true;
+	size_t startCol = 0;
+	for (int i = 0; i < numChars; i++) {
+		while (!occupied[startCol]) {
+			startCol++;
+		}
+		size_t endCol = startCol;
+		while (occupied[endCol]) {
+			endCol++;
+		}
+		int cols = (int) (endCol - startCol);
+		int wordsPerRow = (cols + 63) / 64;
+		uint64_t *bits = calloc((size_t) (rows > 0 ? rows : 1) * wordsPerRow, sizeof(uint64_t));
+		if (bits == NULL) {
+			ok = false;
+			break;
+		}
+		for (int j = 0; j < rows; j++) {
+			for (size_t k = startCol; k < endCol && k < lengths[j]; k++) {
+				if (rawFont[j][k] == '*') {
+					bits[(size_t) j * wordsPerRow + (k - startCol) / 64] |= (uint64_t) 1 << ((k - startCol) % 64);
+				}
+			}
+		}
+		ok = addFontChar(font, keys[i], bits, wordsPerRow, rows, cols, i);
+		if (!ok) {
+			break;
+		}
+		startCol = endCol;
+	}
+
+	free(lengths);
+	free(occupied);
+	free(keyLine);
+	if (!ok) {
+		free_render_font(font);
+		return NULL;
+	}
+	return font;
+}
+
+static char *fontKeys(const char *line) {
+	// Keys are the non-blank characters of the line; the space is never a glyph.
+	char *keys = malloc(strlen(line) + 1);
+	if (keys == NULL) {
+		return NULL;
+	}
+	size_t count = 0;
+	for (size_t i = 0; line[i] != '\0'; i++) {
+		if (!isspace((unsigned char) line[i])) {
+			keys[count++] = line[i];
+		}
+	}
+	keys[count] = '\0';
+	return keys;
+}
+
+static FontChar *getFontChar(Font *font, char key) {
+	// Exact key first, then the upper case letter, so fonts with only capitals still render any case.
+	FontChar *fontChar = font->index[(unsigned char) key];
+	if (fontChar == NULL) {
+		fontChar = font->index[(unsigned char) toupper((unsigned char) key)];
+	}
+	return fontChar;
+}
+
+static int render_message(Image *ptr, Font *font, RenderParams render, int threads) {
+	if (!message_supported(font, render.message, false)) {
+		return MISSING_ARGUMENT;
+	}
+	MessageLayout layout;
+	if (!layout_message(font, render, ptr->width, ptr->height, &layout)) {
+		return MISSING_ARGUMENT;
+	}
+	draw_layout(ptr, 0, &layout, threads);
+	free_layout(&layout);
+	return 0;
+}
+
+static int parse_script(const char *filepath, Script *script) {
+	memset(script, 0, sizeof(*script));
+	FILE *file = strcmp(filepath, "-") == 0 ? stdin : fopen(filepath, "r");
+	if (file == NULL) {
+		return INPUT_FILE_MISSING;
+	}
+	char *line = NULL;
+	size_t size = 0;
+	int result = 0;
+	int lastCopy = -1;
+	while (result == 0 && getline(&line, &size, file) != -1) {
+		result = parse_script_line(line, script, &lastCopy);
+	}
+	free(line);
+	if (file != stdin) {
+		fclose(file);
+	}
+	if (result != 0) {
+		free_script(script);
+	}
+	return result;
+}
+
+static int parse_script_line(char *line, Script *script, int *lastCopy) {
+	// Each line is "copy R,C,W,H", "paste R,C" or "render MESSAGE,FONT,SIZE,R,C", checked like -c, -p and -r.
+	size_t length = strlen(line);
+	while (length > 0 && isspace((unsigned char) line[length - 1])) {
+		line[--length] = '\0';
+	}
+	while (isspace((unsigned char) *line)) {
+		line++;
+	}
+	if (*line == '\0' || *line == '#') {
+		return 0;
+	}
+	char *args = line;
+	while (*args != '\0' && !isspace((unsigned char) *args)) {
+		args++;
+	}
+	if (*args != '\0') {
+		*args++ = '\0';
+		while (isspace((unsigned char) *args)) {
+			args++;
+		}
+	}
+
+	ScriptOp op;
+	memset(&op, 0, sizeof(op));
+	if (strcmp(line, "copy") == 0) {
+		if (!checkCopyParams(args)) return C_ARGUMENT_INVALID;
+		op.type = OP_COPY;
+	} else if (strcmp(line, "paste") == 0) {
+		if (*lastCopy < 0) return C_ARGUMENT_MISSING;
+		if (!checkPasteParams(args)) return P_ARGUMENT_INVALID;
+		op.type = OP_PASTE;
+		op.copy = script->ops[*lastCopy].copy;
+	} else if (strcmp(line, "render") == 0) {
+		if (!checkRenderParams(args)) return R_ARGUMENT_INVALID;
+		op.type = OP_RENDER;
+	} else {
+		return UNRECOGNIZED_ARGUMENT;
+	}
+
+	op.args = split(args, ",");
+	if (op.args == NULL) {
+		return MISSING_ARGUMENT;
+	}
+	if (op.type == OP_COPY) {
+		op.copy = (CopyParams) {atoi(op.args[0]), atoi(op.args[1]), atoi(op.args[2]), atoi(op.args[3])};
+	} else if (op.type == OP_PASTE) {
+		op.paste = (PasteParams) {atoi(op.args[0]), atoi(op.args[1])};
+	} else {
+		// Quotes are optional, so a render line can be pasted from a shell command unchanged.
+		char *message = op.args[0];
+		size_t messageLength = strlen(message);
+		if (messageLength >= 2 && message[0] == '"' && message[messageLength - 1] == '"') {
+			message[messageLength - 1] = '\0';
+			message++;
+		}
+		op.render = (RenderParams) {message, op.args[1], atoi(op.args[2]), atoi(op.args[3]), atoi(op.args[4])};
+	}
+
+	if (script->count == script->capacity) {
+		int capacity = script->capacity == 0 ? 16 : script->capacity * 2;
+		ScriptOp *ops = realloc(script->ops, (size_t) capacity * sizeof(ScriptOp));
+		if (ops == NULL) {
+			freeArr(op.args);
+			return MISSING_ARGUMENT;
+		}
+		script->ops = ops;
+		script->capacity = capacity;
+	}
+	if (op.type == OP_COPY) {
+		*lastCopy = script->count;
+	}
+	script->ops[script->count++] = op;
+	return 0;
+}
+
+static int check_messages(const Script *script, const RenderParams *render, FontCache *cache) {
+	// Loads every font the run needs and reports all unsupported characters, not just the first.
+	bool supported = true;
+	if (render != NULL) {
+		Font *font = font_cache_get(cache, render->fontPath);
+		if (font == NULL) {
+			return MISSING_ARGUMENT;
+		}
+		supported = message_supported(font, render->message, true);
+	}
+	for (int i = 0; i < script->count; i++) {
+		const ScriptOp *op = &script->ops[i];
+		if (op->type == OP_RENDER) {
+			Font *font = font_cache_get(cache, op->render.fontPath);
+			if (font == NULL) {
+				return MISSING_ARGUMENT;
+			}
+			supported = message_supported(font, op->render.message, true) && supported;
+		}
+	}
+	return supported ? 0 : MISSING_ARGUMENT;
+}
+
+static int run_script(Image *img, const Script *script, FontCache *cache, int threads) {
+	// A paste reads the region named by the latest copy from the image as it is at that point.
+	for (int i = 0; i < script->count; i++) {
+		const ScriptOp *op = &script->ops[i];
+		if (op->type == OP_PASTE) {
+			copy_paste(img, op->copy, op->paste, threads);
+		} else if (op->type == OP_RENDER) {
+			Font *font = font_cache_get(cache, op->render.fontPath);
+			if (font == NULL) {
+				return MISSING_ARGUMENT;
+			}
+			int result = render_message(img, font, op->render, threads);
+			if (result != 0) {
+				return result;
+			}
+		}
+	}
+	return 0;
+}
+
+static void free_script(Script *script) {
+	for (int i = 0; i < script->count; i++) {
+		freeArr(script->ops[i].args);
+	}
+	free(script->ops);
+	memset(script, 0, sizeof(*script));
+}
+
+static Font *font_cache_get(FontCache *cache, const char *fontPath) {
+	// A limited cache is long lived, so an entry is only used while its file is unchanged and the least recently
+	// used font makes room for a new one.
+	struct stat info;
+	if (cache->limit > 0 && stat(fontPath, &info) == -1) {
+		return NULL;
+	}
+	for (int i = 0; i < cache->count; i++) {
+		FontCacheEntry *entry = &cache->entries[i];
+		if (strcmp(entry->path, fontPath) != 0) {
+			continue;
+		}
+		if (cache->limit == 0) {
+			return entry->font;
+		}
+		if (entry->device == info.st_dev && entry->inode == info.st_ino &&
+			entry->modified.tv_sec == info.st_mtim.tv_sec && entry->modified.tv_nsec == info.st_mtim.tv_nsec) {
+			FontCacheEntry used = *entry;
+			memmove(entry, entry + 1, (size_t) (cache->count - i - 1) * sizeof(FontCacheEntry));
+			cache->entries[cache->count - 1] = used;
+			return used.font;
+		}
+		font_cache_remove(cache, i);
+		break;
+	}
+	if (cache->limit > 0 && cache->count >= cache->limit) {
+		font_cache_remove(cache, 0);
+	}
+	if (cache->count == cache->capacity) {
+		int capacity = cache->capacity == 0 ? 4 : cache->capacity * 2;
+		FontCacheEntry *entries = realloc(cache->entries, (size_t) capacity * sizeof(FontCacheEntry));
+		if (entries == NULL) {
+			return NULL;
+		}
+		cache->entries = entries;
+		cache->capacity = capacity;
+	}
+	char *path = strdup(fontPath);
+	if (path == NULL) {
+		return NULL;
+	}
+	Font *font = load_render_font(fontPath);
+	if (font == NULL) {
+		free(path);
+		return NULL;
+	}
+	FontCacheEntry entry = {path, 0, 0, {0, 0}, font};
+	if (cache->limit > 0) {
+		entry.device = info.st_dev;
+		entry.inode = info.st_ino;
+		entry.modified = info.st_mtim;
+	}
+	cache->entries[cache->count++] = entry;
+	return font;
+}
+
+static void font_cache_free(FontCache *cache) {
+	while (cache->count > 0) {
+		font_cache_remove(cache, cache->count - 1);
+	}
+	free(cache->entries);
+	memset(cache, 0, sizeof(*cache));
+}
+
+static bool font_cache_share(FontCache *copy, const FontCache *cache, pthread_mutex_t *lock) {
+	// Called with lock held. The copy takes its own hold on every font, so the fonts outlive their eviction
+	// from the shared cache while a job still draws with them.
+	*copy = (FontCache) {NULL, 0, 0, 0, lock};
+	if (cache->count == 0) {
+		return true;
+	}
+	copy->entries = malloc((size_t) cache->count * sizeof(FontCacheEntry));
+	if (copy->entries == NULL) {
+		return false;
+	}
+	copy->capacity = cache->count;
+	for (int i = 0; i < cache->count; i++) {
+		FontCacheEntry entry = cache->entries[i];
+		entry.path = strdup(entry.path);
+		if (entry.path == NULL) {
+			copy->lock = NULL;	// already held
+			font_cache_free(copy);
+			return false;
+		}
+		entry.font->users++;
+		copy->entries[copy->count++] = entry;
+	}
+	return true;
+}
+
+static void font_cache_remove(FontCache *cache, int i) {
+	FontCacheEntry entry = cache->entries[i];
+	memmove(&cache->entries[i], &cache->entries[i + 1], (size_t) (cache->count - i - 1) * sizeof(FontCacheEntry));
+	cache->count--;
+	free(entry.path);
+	if (cache->lock != NULL) {
+		pthread_mutex_lock(cache->lock);
+	}
+	bool last = --entry.font->users == 0;
+	if (cache->lock != NULL) {
+		pthread_mutex_unlock(cache->lock);
+	}
+	if (last) {
+		free_render_font(entry.font);
+	}
+}
+
+static Font *load_render_font(const char *fontPath) {
+	// Only compiled fonts are mapped; the magic is checked with pread so text fonts are read once, as text.
+	int fd = open(fontPath, O_RDONLY);
+	if (fd == -1) {
+		return NULL;
+	}
+	char magic[4];
+	if (pread(fd, magic, sizeof(magic), 0) == (ssize_t) sizeof(magic) && memcmp(magic, FONT_MAGIC, 4) == 0) {
+		FileData file;
+		if (!map_descriptor(fd, &file)) {
+			return NULL;
+		}
+		Font *font = file.size >= sizeof(FontFileHeader) ? load_compiled_font(&file) : NULL;
+		unmap_file(&file);
+		return font;
+	}
+	close(fd);
+	char **fonts = loadFontsRaw(fontPath);
+	if (fonts == NULL) {
+		return NULL;
+	}
+	Font *font = loadFont(fonts);
+	freeFontsRaw(fonts);
+	return font;
+}
+
+static int compile_font(const char *fontPath, const char *outputPath) {
+	// Layout: header, glyph directory, then per glyph its row run indices and its runs, so that loading needs
+	// neither the bitmap nor buildGlyphRuns. Each glyph's block is padded to 8 bytes.
+	char **fonts = loadFontsRaw(fontPath);
+	if (fonts == NULL) {
+		return INPUT_FILE_MISSING;
+	}
+	Font *font = loadFont(fonts);
+	freeFontsRaw(fonts);
+	if (font == NULL) {
+		return INPUT_FILE_MISSING;
+	}
+
+	uint32_t rows = font->numChars > 0 ? (uint32_t) font->characters[0].rows : 0;
+	FontFileHeader header = {{'H', 'W', '2', 'F'}, FONT_VERSION, (uint32_t) font->numChars, rows};
+	uint64_t offset = sizeof(header) + (uint64_t) font->numChars * sizeof(FontGlyphEntry);
+	OutputBuffer out;
+	if (!output_open(&out, outputPath)) {
+		free_render_font(font);
+		return OUTPUT_FILE_UNWRITABLE;
+	}
+	output_write(&out, &header, sizeof(header));
+	for (int i = 0; i < font->numChars; i++) {
+		FontChar *fontChar = &font->characters[i];
+		const GlyphMetrics *metrics = &fontChar->metrics;
+		uint32_t numRuns = (uint32_t) fontChar->rowRuns[rows];
+		FontGlyphEntry entry = {(unsigned char) fontChar->key, (uint32_t) fontChar->cols, numRuns,
+								metrics->inkTop, metrics->inkBottom, metrics->inkLeft, metrics->inkRight, 0, offset};
+		output_write(&out, &entry, sizeof(entry));
+		uint64_t blockBytes = ((uint64_t) rows + 1) * sizeof(int32_t) + (uint64_t) numRuns * sizeof(GlyphRun);
+		offset += (blockBytes + 7) & ~(uint64_t) 7;
+	}
+	static const unsigned char padding[8] = {0};
+	for (int i = 0; i < font->numChars; i++) {
+		FontChar *fontChar = &font->characters[i];
+		size_t numRuns = (size_t) fontChar->rowRuns[rows];
+		size_t blockBytes = ((size_t) rows + 1) * sizeof(int32_t) + numRuns * sizeof(GlyphRun);
+		output_write(&out, fontChar->rowRuns, ((size_t) rows + 1) * sizeof(int32_t));
+		output_write(&out, fontChar->runs, numRuns * sizeof(GlyphRun));
+		output_write(&out, padding, ((blockBytes + 7) & ~(size_t) 7) - blockBytes);
+	}
+	free_render_font(font);
+	return output_close(&out) ? 0 : OUTPUT_FILE_UNWRITABLE;
+}
+
+static Font *load_compiled_font(FileData *file) {
+	// Every count comes from the file, so each is bounded before it is used in size arithmetic or cast to int.
+	const FontFileHeader *header = (const FontFileHeader *) file->data;
+	uint64_t directoryEnd = sizeof(*header) + (uint64_t) header->numGlyphs * sizeof(FontGlyphEntry);
+	if (header->version != FONT_VERSION || directoryEnd > file->size || header->numGlyphs > INT32_MAX ||
+		header->rows > FONT_MAX_GLYPH_SIZE || (uint64_t) header->rows * header->numGlyphs > file->size) {
+		return NULL;
+	}
+	int rows = (int) header->rows;
+	const FontGlyphEntry *entries = (const FontGlyphEntry *) (file->data + sizeof(*header));
+	for (uint32_t i = 0; i < header->numGlyphs; i++) {
+		const FontGlyphEntry *entry = &entries[i];
+		uint64_t blockBytes = ((uint64_t) rows + 1) * sizeof(int32_t) + (uint64_t) entry->numRuns * sizeof(GlyphRun);
+		if (entry->offset % sizeof(uint64_t) != 0 || entry->offset < directoryEnd || entry->offset > file->size ||
+			blockBytes > file->size - entry->offset || entry->cols > FONT_MAX_GLYPH_SIZE || entry->key > 255 ||
+			!compiled_glyph_valid(entry, rows, (const int32_t *) (file->data + entry->offset),
+								  (const GlyphRun *) (file->data + entry->offset + ((size_t) rows + 1) * sizeof(int32_t)))) {
+			return NULL;
+		}
+	}
+
+	// Runs, run indices and metrics are used as stored; the font takes over the mapping and releases it in freeFont.
+	Font *font = malloc(sizeof(Font));
+	if (font == NULL) {
+		return NULL;
+	}
+	initFont(font, (int) header->numGlyphs);
+	font->file = *file;
+	for (int i = 0; i < font->numChars; i++) {
+		const FontGlyphEntry *entry = &entries[i];
+		unsigned char *block = (unsigned char *) file->mapping + entry->offset;
+		FontChar *fontChar = &font->characters[i];
+		fontChar->key = (char) entry->key;
+		fontChar->rows = rows;
+		fontChar->cols = (int) entry->cols;
+		fontChar->rowRuns = (int *) block;
+		fontChar->runs = (GlyphRun *) (block + ((size_t) rows + 1) * sizeof(int32_t));
+		fontChar->metrics = (GlyphMetrics) {entry->inkTop, entry->inkBottom, entry->inkLeft, entry->inkRight,
+											fontChar->cols};
+		if (font->index[entry->key] == NULL) {
+			font->index[entry->key] = fontChar;
+		}
+	}
+	*file = (FileData) {NULL, 0, NULL};
+	return font;
+}
+
+static bool compiled_glyph_valid(const FontGlyphEntry *entry, int rows, const int32_t *rowRuns, const GlyphRun *runs) {
+	// Drawing trusts the runs to stay inside the ink box that fontOverlaps checks, so that is verified here.
+	int cols = (int) entry->cols;
+	if (entry->inkTop < 0 || entry->inkTop > entry->inkBottom || entry->inkBottom > rows || entry->inkLeft < 0 ||
+		entry->inkLeft > entry->inkRight || entry->inkRight > cols || entry->numRuns > (uint64_t) rows * cols ||
+		rowRuns[0] != 0 || (uint32_t) rowRuns[rows] != entry->numRuns) {
+		return false;
+	}
+	for (int j = 0; j < rows; j++) {
+		if (rowRuns[j] > rowRuns[j + 1] || rowRuns[j + 1] > rowRuns[rows]) {
+			return false;
+		}
+		if (rowRuns[j] < rowRuns[j + 1] && (j < entry->inkTop || j >= entry->inkBottom)) {
+			return false;
+		}
+		for (int r = rowRuns[j]; r < rowRuns[j + 1]; r++) {
+			if (runs[r].length <= 0 || runs[r].start < entry->inkLeft || runs[r].start > entry->inkRight - runs[r].length) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void free_render_font(Font *font) {
+	freeFont(font);
+	free(font);
+}
+
+static bool message_supported(Font *font, const char *message, bool report) {
+	// With report set, every character the font lacks is reported once, before anything is drawn.
+	bool reported[256] = {false};
+	bool supported = true;
+	for (size_t i = 0; message[i] != '\0'; i++) {
+		unsigned char c = (unsigned char) message[i];
+		if (c != ' ' && getFontChar(font, message[i]) == NULL) {
+			if (report && !reported[c]) {
+				fprintf(stderr, "Font has no glyph for '%c'.\n", c);
+				reported[c] = true;
+			}
+			supported = false;
+		}
+	}
+	return supported;
+}
+
+static bool layout_message(Font *font, RenderParams render, int width, int height, MessageLayout *layout) {
+	// Positions are fixed for the whole message before anything is drawn; glyphs that would not fit
+	// are dropped here but still advance the pen. The pen is 64-bit so a large column or size cannot wrap
+	// it back into the image, and layout stops once it has passed the right edge.
+	size_t length = strlen(render.message);
+	*layout = (MessageLayout) {malloc((length > 0 ? length : 1) * sizeof(GlyphPlacement)), 0, NULL, 0,
+							   render.row, render.fontSize, 0, 0, 0};
+	if (layout->glyphs == NULL) {
+		return false;
+	}
+	int size = render.fontSize;
+	int64_t pen = render.col;
+	bool ok = true;
+	pthread_mutex_lock(&font->scaledLock);
+	for (size_t i = 0; i < length && ok && pen < width; i++) {
+		if (render.message[i] == ' ') {
+			pen += 5;
+			continue;
+		}
+
+		FontChar *fontChar = getFontChar(font, render.message[i]);
+		const GlyphMetrics *metrics = &fontChar->metrics;
+		if (size > 0 && metrics->inkTop < metrics->inkBottom &&
+			!fontOverlaps(width, height, render.row, pen, fontChar, size)) {
+			// The glyph fits, so its rows and column are within the image and fit in an int.
+			int top = (int) (render.row + (int64_t) metrics->inkTop * size);
+			int bottom = (int) (render.row + (int64_t) metrics->inkBottom * size);
+			if (layout->count == 0 || top < layout->top) layout->top = top;
+			if (layout->count == 0 || bottom > layout->bottom) layout->bottom = bottom;
+			layout->inkBytes += (uint64_t) (bottom - top) * (uint64_t) (metrics->inkRight - metrics->inkLeft) *
+								(uint64_t) size * sizeof(Pixel);
+			const ScaledGlyph *scaled = getScaledChar(font, fontChar, size, layout);
+			ok = scaled != NULL;
+			layout->glyphs[layout->count++] = (GlyphPlacement) {fontChar, scaled, (int) pen};
+		}
+		pen += (int64_t) metrics->advance * size + 1;
+	}
+	pthread_mutex_unlock(&font->scaledLock);
+	if (!ok) {
+		free_layout(layout);
+	}
+	return ok;
+}
+
+static const ScaledGlyph *getScaledChar(Font *font, FontChar *fontChar, int fontSize, MessageLayout *layout) {
+	// Scaled glyphs are built on first use and kept per size until the font is freed. Past
+	// FONT_SCALED_SIZES distinct sizes they are built for this layout only. Called with scaledLock held.
+	ScaledGlyphs *scaled = NULL;
+	for (int i = 0; i < font->numScaled; i++) {
+		if (font->scaled[i].size == fontSize) {
+			scaled = &font->scaled[i];
+			break;
+		}
+	}
+	if (scaled == NULL && font->numScaled < FONT_SCALED_SIZES) {
+		ScaledGlyph **glyphs = calloc(font->numChars > 0 ? font->numChars : 1, sizeof(ScaledGlyph *));
+		if (glyphs == NULL) {
+			return NULL;
+		}
+		scaled = &font->scaled[font->numScaled++];
+		*scaled = (ScaledGlyphs) {fontSize, glyphs};
+	}
+	if (scaled == NULL) {
+		ScaledGlyph **owned = realloc(layout->owned, (size_t) (layout->numOwned + 1) * sizeof(ScaledGlyph *));
+		if (owned == NULL) {
+			return NULL;
+		}
+		layout->owned = owned;
+		layout->owned[layout->numOwned] = scaleFontChar(fontChar, fontSize);
+		return layout->owned[layout->numOwned] == NULL ? NULL : layout->owned[layout->numOwned++];
+	}
+	int index = (int) (fontChar - font->characters);
+	if (scaled->glyphs[index] == NULL) {
+		scaled->glyphs[index] = scaleFontChar(fontChar, fontSize);
+	}
+	return scaled->glyphs[index];
+}
+
+static ScaledGlyph *scaleFontChar(const FontChar *fontChar, int fontSize) {
+	// Runs are stored in pixels and each image row of the glyph knows its source row, so drawing needs no
+	// division by the size. Only the rows down to the ink bottom are kept, which a glyph that fits bounds
+	// by the image height.
+	int numRuns = fontChar->rowRuns[fontChar->rows];
+	int lines = fontChar->metrics.inkBottom * fontSize;
+	ScaledGlyph *scaled = malloc(sizeof(ScaledGlyph) + (size_t) numRuns * sizeof(GlyphRun) + (size_t) lines * sizeof(int));
+	if (scaled == NULL) {
+		return NULL;
+	}
+	scaled->runs = (GlyphRun *) (scaled + 1);
+	scaled->lineRows = (int *) (scaled->runs + numRuns);
+	scaled->top = fontChar->metrics.inkTop * fontSize;
+	scaled->bottom = lines;
+	for (int i = 0; i < numRuns; i++) {
+		scaled->runs[i] = (GlyphRun) {fontChar->runs[i].start * fontSize, fontChar->runs[i].length * fontSize};
+	}
+	for (int j = 0; j < lines; j++) {
+		scaled->lineRows[j] = j / fontSize;
+	}
+	return scaled;
+}
+
+static void draw_layout(Image *band, int firstRow, const MessageLayout *layout, int threads) {
+	// band holds image rows [firstRow, firstRow + band->height). Rows are rasterised top to bottom across
+	// all glyphs, and large messages are split into horizontal bands, one per thread.
+	int from = layout->top > firstRow ? layout->top : firstRow;
+	int to = layout->bottom < firstRow + band->height ? layout->bottom : firstRow + band->height;
+	if (from >= to) {
+		return;
+	}
+	RasterTask task = {layout, band, firstRow, from, to};
+	if (threads > 1 && layout->inkBytes >= PARALLEL_MIN_BYTES) {
+		if (threads > to - from) {
+			threads = to - from;
+		}
+		RasterTask *tasks = malloc((size_t) threads * sizeof(RasterTask));
+		if (tasks != NULL) {
+			for (int i = 0; i < threads; i++) {
+				tasks[i] = task;
+				tasks[i].from = from + (int) ((int64_t) (to - from) * i / threads);
+				tasks[i].to = from + (int) ((int64_t) (to - from) * (i + 1) / threads);
+			}
+			bool ok = run_parallel(tasks, sizeof(RasterTask), threads, raster_rows);
+			free(tasks);
+			if (ok) {
+				return;
+			}
+		}
+	}
+	raster_rows(&task);
+}
+
+static void *raster_rows(void *arg) {
+	RasterTask *task = arg;
+	const MessageLayout *layout = task->layout;
+	for (int y = task->from; y < task->to; y++) {
+		Pixel *row = image_row(task->band, y - task->firstRow);
+		int cell = y - layout->row;
+		for (int i = 0; i < layout->count; i++) {
+			const ScaledGlyph *scaled = layout->glyphs[i].scaled;
+			if (cell < scaled->top || cell >= scaled->bottom) {
+				continue;
+			}
+			const int *rowRuns = layout->glyphs[i].glyph->rowRuns + scaled->lineRows[cell];
+			Pixel *origin = row + layout->glyphs[i].col;
+			const GlyphRun *end = scaled->runs + rowRuns[1];
+			for (const GlyphRun *run = scaled->runs + rowRuns[0]; run < end; run++) {
+				fill_white_span(origin + run->start, run->length);
+			}
+		}
+	}
+	return NULL;
+}
+
+static void free_layout(MessageLayout *layout) {
+	for (int i = 0; i < layout->numOwned; i++) {
+		free(layout->owned[i]);
+	}
+	free(layout->owned);
+	free(layout->glyphs);
+	layout->glyphs = NULL;
+	layout->owned = NULL;
+	layout->count = 0;
+	layout->numOwned = 0;
+}
+
+static void fill_white_span(Pixel *row, int length) {
+	memset(row, 0xFF, (size_t) length * sizeof(Pixel));
+}
+
+static bool fontOverlaps(int width, int height, int64_t row, int64_t col, const FontChar *pChar, int fontSize) {
+	// The whole scaled ink box, near and far corners, must lie inside the image; the pen and the scaled
+	// extents are 64-bit so that no position wraps around into it.
+	const GlyphMetrics *metrics = &pChar->metrics;
+	if (metrics->inkTop == metrics->inkBottom) {
+		return false;
+	}
+	int64_t top = row + (int64_t) metrics->inkTop * fontSize;
+	int64_t bottom = row + (int64_t) metrics->inkBottom * fontSize;
+	int64_t left = col + (int64_t) metrics->inkLeft * fontSize;
+	int64_t right = col + (int64_t) metrics->inkRight * fontSize;
+	return row < 0 || col < 0 || top < 0 || left < 0 || bottom > height || right > width;
+}
+
+
+static int resolve_threads(int threads) {
+	if (threads <= 0) {
+		return default_threads();
+	}
+	return threads > MAX_THREADS ? MAX_THREADS : threads;
+}
+
+static int image_from_reader(RowReader *reader, int threads, hw2_image **image) {
+	LoadParams params = {resolve_threads(threads)};
+	Image img;
+	if (!decode_image(reader, params, &img)) {
+		return INPUT_FILE_MISSING;
+	}
+	*image = malloc(sizeof(hw2_image));
+	if (*image == NULL) {
+		free_image(img);
+		return MISSING_ARGUMENT;
+	}
+	memset(*image, 0, sizeof(hw2_image));
+	(*image)->image = img;
+	return 0;
+}
+
+static ImageFormat library_format(hw2_format format) {
+	// HW2_FORMAT_AUTO and values outside the enum have no fixed encoding.
+	switch (format) {
+		case HW2_FORMAT_PPM_ASCII:
+			return FORMAT_PPM_ASCII;
+		case HW2_FORMAT_PPM_BINARY:
+			return FORMAT_PPM_BINARY;
+		case HW2_FORMAT_SBU:
+			return FORMAT_SBU;
+		case HW2_FORMAT_SBU_BINARY:
+			return FORMAT_SBU_BINARY;
+		default:
+			return FORMAT_NONE;
+	}
+}
+
+int hw2_image_load(const char *path, int threads, hw2_image **image) {
+	struct stat source;
+	RowReader reader;
+	if (!input_stat(path, &source) || !reader_open(&reader, path)) {
+		return INPUT_FILE_MISSING;
+	}
+	int result = image_from_reader(&reader, threads, image);
+	if (result == 0) {
+		(*image)->source = source;
+	}
+	return result;
+}
+
+int hw2_image_load_memory(const void *data, size_t size, int threads, hw2_image **image) {
+	RowReader reader;
+	if (!reader_open_memory(&reader, data, size)) {
+		return INPUT_FILE_MISSING;
+	}
+	return image_from_reader(&reader, threads, image);
+}
+
+int hw2_image_save(const hw2_image *image, const char *path, hw2_format format) {
+	ImageFormat imageFormat = library_format(format);
+	if (format == HW2_FORMAT_AUTO) {
+		SaveParams params = {false, false, NULL};
+		imageFormat = output_format(path, params);
+	}
+	if (imageFormat == FORMAT_NONE) {
+		return UNRECOGNIZED_ARGUMENT;
+	}
+	// Like an in-place job, a zero-copy image saved over its own file is copied before the file is truncated.
+	const Image *img = &image->image;
+	Image copy = empty_image();
+	struct stat st;
+	if (img->mapping != NULL && strcmp(path, "-") != 0 && stat(path, &st) == 0 &&
+		st.st_dev == image->source.st_dev && st.st_ino == image->source.st_ino) {
+		if (!clone_image(img, &copy)) {
+			return MISSING_ARGUMENT;
+		}
+		img = &copy;
+	}
+	bool ok = save_with_format(img, path, imageFormat);
+	free_image(copy);
+	return ok ? 0 : OUTPUT_FILE_UNWRITABLE;
+}
+
+int hw2_image_save_memory(const hw2_image *image, hw2_format format, void **data, size_t *size) {
+	ImageFormat imageFormat = library_format(format);
+	if (imageFormat == FORMAT_NONE) {
+		return UNRECOGNIZED_ARGUMENT;
+	}
+	OutputBuffer out;
+	if (!encode_image(&image->image, NULL, imageFormat, &out)) {
+		return MISSING_ARGUMENT;
+	}
+	*data = out.data;
+	*size = out.length;
+	return 0;
+}
+
+void hw2_image_free(hw2_image *image) {
+	if (image != NULL) {
+		free_image(image->image);
+		free(image);
+	}
+}
+
+int hw2_image_width(const hw2_image *image) {
+	return image->image.width;
+}
+
+int hw2_image_height(const hw2_image *image) {
+	return image->image.height;
+}
+
+const unsigned char *hw2_image_row(const hw2_image *image, int row) {
+	if (row < 0 || row >= image->image.height) {
+		return NULL;
+	}
+	return (const unsigned char *) image_row(&image->image, row);
+}
+
+int hw2_copy_paste(hw2_image *image, int row, int col, int width, int height, int pasteRow, int pasteCol,
+				   int threads) {
+	if (row < 0 || col < 0 || width < 0 || height < 0) {
+		return C_ARGUMENT_INVALID;
+	}
+	if (pasteRow < 0 || pasteCol < 0) {
+		return P_ARGUMENT_INVALID;
+	}
+	return copy_paste(&image->image, (CopyParams) {row, col, width, height}, (PasteParams) {pasteRow, pasteCol},
+					  resolve_threads(threads));
+}
+
+int hw2_font_load(const char *path, hw2_font **font) {
+	Font *loaded = load_render_font(path);
+	if (loaded == NULL) {
+		return INPUT_FILE_MISSING;
+	}
+	*font = malloc(sizeof(hw2_font));
+	if (*font == NULL) {
+		free_render_font(loaded);
+		return MISSING_ARGUMENT;
+	}
+	(*font)->font = loaded;
+	return 0;
+}
+
+void hw2_font_free(hw2_font *font) {
+	if (font != NULL) {
+		free_render_font(font->font);
+		free(font);
+	}
+}
+
+int hw2_font_height(const hw2_font *font) {
+	return font->font->numChars > 0 ? font->font->characters[0].rows : 0;
+}
+
+int hw2_render(hw2_image *image, const hw2_font *font, const char *message, int size, int row, int col,
+			   int threads) {
+	if (message == NULL) {
+		return MISSING_ARGUMENT;
+	}
+	if (size < 0 || row < 0 || col < 0) {
+		return R_ARGUMENT_INVALID;
+	}
+	RenderParams render = {(char *) message, NULL, size, row, col};
+	return render_message(&image->image, font->font, render, resolve_threads(threads));
+}
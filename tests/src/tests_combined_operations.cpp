@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string>
 #include "gtest/gtest.h"
 #include "tests_aux.h"
@@ -17,6 +19,16 @@ class image_operations_TestSuite : public testing::Test {
 
 extern char cmd[300];
 
+// Stops a daemon started in the background if its test returns before shutting it down
+struct DaemonGuard {
+    const char *pid_file;
+    ~DaemonGuard() {
+        char kill_cmd[300];
+        sprintf(kill_cmd, "kill $(cat %s) 2>/dev/null", pid_file);
+        system(kill_cmd);
+    }
+};
+
 // Copy & paste operations plus text rendering
 // Copied region does not overlap the text.
 TEST_F(image_operations_TestSuite, combined1) {
@@ -54,3 +66,179 @@ TEST_F(image_operations_TestSuite, combined3) {
     EXPECT_EQ(0, WEXITSTATUS(status));
     check_image_file_contents(expected_output_file, actual_output_file);
 }
+
+// Copy & paste operations plus text rendering, streamed in row bands under a small memory budget
+TEST_F(image_operations_TestSuite, combined2_streaming) {
+    const char *input_file = "./tests/images/stony.sbu";
+    const char *expected_output_file = "./tests/expected_outputs/combined2.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -c 125,130,150,40 -i %s -p 85,130 -o %s -r \"Go STONY BROOK\",\"./tests/fonts/font4.txt\",2,100,10 --max-memory 1088K", input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Streaming mode writing SBU, which needs a palette pass before the runs, in bands of a single row
+TEST_F(image_operations_TestSuite, combined3_streaming_sbu) {
+    const char *input_file = "./tests/images/stony.ppm";
+    const char *streamed_output_file = "./tests/actual_outputs/result.sbu";
+    const char *expected_output_file = "./tests/expected_outputs/combined3.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -c 125,130,150,40 -p 85,130 -i %s -o %s -r \"NEw york state\",\"./tests/fonts/font3.txt\",5,50,5 --max-memory 1048K", input_file, streamed_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", streamed_output_file, actual_output_file);
+    status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Copy & paste operations plus text rendering, read from a script
+TEST_F(image_operations_TestSuite, combined1_script) {
+    const char *input_file = "./tests/images/stony.sbu";
+    const char *expected_output_file = "./tests/expected_outputs/combined1.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s -s ./tests/scripts/combined1.txt", input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// A script with repeated pastes and renders matches the same operations run one invocation at a time
+TEST_F(image_operations_TestSuite, script_matches_chained_runs) {
+    const char *input_file = "./tests/images/stony.ppm";
+    const char *expected_output_file = "./tests/actual_outputs/chained.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    const char *steps[] = {
+        "-c 125,130,150,40 -p 85,130",
+        "-c 125,130,150,40 -p 10,10",
+        "-r STONY,./tests/fonts/font1.txt,2,50,5",
+        "-r BROOK,./tests/fonts/font1.txt,2,150,5",
+        "-c 0,0,60,60 -p 200,300",
+    };
+    const char *chained_input_file = "./tests/actual_outputs/chained_in.ppm";
+    sprintf(cmd, "cp %s %s", input_file, chained_input_file);
+    system(cmd);
+    for (const char *step : steps) {
+        sprintf(cmd, "./build/hw2_main -i %s -o %s %s", chained_input_file, expected_output_file, step);
+        int status = run_using_system(cmd);
+        EXPECT_EQ(0, WEXITSTATUS(status));
+        sprintf(cmd, "cp %s %s", expected_output_file, chained_input_file);
+        system(cmd);
+    }
+    sprintf(cmd, "./build/hw2_main -i %s -o %s -s - < ./tests/scripts/stamps.txt", input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// A batch runs every job of the manifest and reports each job's exit code by line
+TEST_F(image_operations_TestSuite, batch_manifest) {
+    const char *report_file = "./tests/actual_outputs/batch1.log";
+    sprintf(cmd, "./build/hw2_main --batch ./tests/scripts/batch1.txt --threads 3 > %s", report_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(C_ARGUMENT_MISSING, WEXITSTATUS(status));
+    check_image_file_contents("./tests/expected_outputs/combined1.ppm", "./tests/actual_outputs/batch_combined1.ppm");
+    check_image_file_contents("./tests/expected_outputs/combined3.ppm", "./tests/actual_outputs/batch_combined3.ppm");
+    check_image_file_contents("./tests/expected_outputs/cactus.ppm", "./tests/actual_outputs/batch_cactus.ppm");
+    check_image_file_contents("./tests/expected_outputs/stony1_1.ppm", "./tests/actual_outputs/batch_stony1_1.ppm");
+    char report[100] = {0};
+    FILE *file = fopen(report_file, "r");
+    ASSERT_NE(nullptr, file);
+    fread(report, 1, sizeof(report) - 1, file);
+    fclose(file);
+    EXPECT_STREQ("2 0\n3 0\n4 0\n6 6\n7 0\n", report);
+}
+
+// Batch jobs cannot read a script from stdin, which may be carrying the manifest itself
+TEST_F(image_operations_TestSuite, batch_stdin_script) {
+    const char *report_file = "./tests/actual_outputs/batch_stdin.log";
+    sprintf(cmd, "./build/hw2_main --batch - > %s <<'EOF'\n"
+                 "-i ./tests/images/desert.ppm -o ./tests/actual_outputs/batch_script.ppm -s -\n"
+                 "-c 90,10,50,100 -i ./tests/images/desert.ppm -o ./tests/actual_outputs/batch_cactus.ppm -p 90,60\n"
+                 "EOF", report_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(UNRECOGNIZED_ARGUMENT, WEXITSTATUS(status));
+    check_image_file_contents("./tests/expected_outputs/cactus.ppm", "./tests/actual_outputs/batch_cactus.ppm");
+    char report[100] = {0};
+    FILE *file = fopen(report_file, "r");
+    ASSERT_NE(nullptr, file);
+    fread(report, 1, sizeof(report) - 1, file);
+    fclose(file);
+    EXPECT_STREQ("1 2\n2 0\n", report);
+}
+
+// A --serve daemon runs jobs sent by --client and answers with each job's exit code
+TEST_F(image_operations_TestSuite, serve_client) {
+    const char *input_file = "./tests/images/stony.sbu";
+    const char *socket_file = "./tests/actual_outputs/hw2.sock";
+    const char *pid_file = "./tests/actual_outputs/hw2.pid";
+    const char *expected_output_file = "./tests/expected_outputs/combined1.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main --serve %s --threads 2 & echo $! > %s", socket_file, pid_file);
+    run_using_system(cmd);
+    DaemonGuard guard = {pid_file};
+    for (int i = 0; i < 250 && !file_exists(socket_file); i++) {
+        usleep(20000);
+    }
+    ASSERT_TRUE(file_exists(socket_file));
+    sprintf(cmd, "./build/hw2_main --client %s -c 125,130,150,40 -p 85,130 -i %s -o %s -r \"Go STONY BROOK\",\"./tests/fonts/font1.txt\",2,50,5", socket_file, input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+    sprintf(cmd, "./build/hw2_main --client %s -i %s -o %s -p 85,130", socket_file, input_file, actual_output_file);
+    status = run_using_system(cmd);
+    EXPECT_EQ(C_ARGUMENT_MISSING, WEXITSTATUS(status));
+
+    // Quotes, backslashes and blanks in an argument reach the server unchanged
+    sprintf(cmd, "cp %s './tests/actual_outputs/in \"stony\" \\ sbu'", input_file);
+    system(cmd);
+    sprintf(cmd, "./build/hw2_main --client %s -i './tests/actual_outputs/in \"stony\" \\ sbu' -o %s -c 125,130,150,40 -p 85,130 -r \"Go STONY BROOK\",\"./tests/fonts/font1.txt\",2,50,5", socket_file, actual_output_file);
+    INFO(cmd);
+    status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+
+    // A font rewritten in place is loaded again instead of being served from the cache
+    system("cp ./tests/fonts/font1.txt ./tests/actual_outputs/font.txt");
+    sprintf(cmd, "./build/hw2_main --client %s -i %s -o %s -r \"Go\",\"./tests/actual_outputs/font.txt\",2,50,5", socket_file, input_file, actual_output_file);
+    status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    system(": > ./tests/actual_outputs/font.txt && touch -d 2001-01-01 ./tests/actual_outputs/font.txt");
+    status = run_using_system(cmd);
+    EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
+
+    // An idle connection must not keep the daemon alive after shutdown
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_file);
+    int idle = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(0, connect(idle, (struct sockaddr *) &address, sizeof(address)));
+    sprintf(cmd, "./build/hw2_main --client %s shutdown", socket_file);
+    status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    for (int i = 0; i < 250 && file_exists(socket_file); i++) {
+        usleep(20000);
+    }
+    EXPECT_FALSE(file_exists(socket_file));
+    close(idle);
+}
+
+// --serve refuses to replace anything at its path that is not a socket
+TEST_F(image_operations_TestSuite, serve_over_regular_file) {
+    const char *socket_file = "./tests/actual_outputs/hw2.sock";
+    sprintf(cmd, "cp ./tests/images/seawolf.ppm %s", socket_file);
+    system(cmd);
+    sprintf(cmd, "./build/hw2_main --serve %s", socket_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(OUTPUT_FILE_UNWRITABLE, WEXITSTATUS(status));
+    check_image_file_contents("./tests/images/seawolf.ppm", socket_file);
+}
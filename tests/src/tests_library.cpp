@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "tests_aux.h"
+#include "libhw2.h"
+
+using namespace std;
+
+class library_TestSuite : public testing::Test {
+	void SetUp() override {
+        system("rm -rf ./tests/actual_outputs");
+		mkdir("./tests/actual_outputs/", 0700);
+	}
+};
+
+static vector<unsigned char> read_file(const char *path) {
+    vector<unsigned char> bytes;
+    FILE *file = fopen(path, "rb");
+    if (file != NULL) {
+        int c;
+        while ((c = fgetc(file)) != EOF) {
+            bytes.push_back((unsigned char) c);
+        }
+        fclose(file);
+    }
+    return bytes;
+}
+
+// Load, copy and paste, and save without starting a process
+TEST_F(library_TestSuite, copy_paste_cactus) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *expected_output_file = "./tests/expected_outputs/cactus.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    hw2_image *image = NULL;
+    ASSERT_EQ(0, hw2_image_load(input_file, 2, &image));
+    EXPECT_EQ(0, hw2_copy_paste(image, 90, 10, 50, 100, 90, 60, 2));
+    EXPECT_EQ(0, hw2_image_save(image, actual_output_file, HW2_FORMAT_AUTO));
+    hw2_image_free(image);
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Render a message with a font loaded once
+TEST_F(library_TestSuite, render_message) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message3_1.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    hw2_image *image = NULL;
+    hw2_font *font = NULL;
+    ASSERT_EQ(0, hw2_image_load(input_file, 0, &image));
+    ASSERT_EQ(0, hw2_font_load("./tests/fonts/font1.txt", &font));
+    EXPECT_EQ(0, hw2_render(image, font, "new YORK state", 2, 40, 180, 0));
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(MISSING_ARGUMENT, hw2_render(image, font, "route 25a", 2, 40, 180, 0));
+    EXPECT_EQ("", testing::internal::GetCapturedStderr());
+    EXPECT_EQ(0, hw2_render(image, font, "AB AB", 1, 1, 2147483640, 0));
+    EXPECT_EQ(0, hw2_render(image, font, "AB AB", 2147483647, 1, 1, 0));
+    EXPECT_EQ(0, hw2_image_save(image, actual_output_file, HW2_FORMAT_PPM_ASCII));
+    hw2_font_free(font);
+    hw2_image_free(image);
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Decode from and encode to memory buffers
+TEST_F(library_TestSuite, load_save_memory) {
+    vector<unsigned char> sbu = read_file("./tests/images/desert.sbu");
+    ASSERT_FALSE(sbu.empty());
+    hw2_image *image = NULL;
+    ASSERT_EQ(0, hw2_image_load_memory(sbu.data(), sbu.size(), 1, &image));
+    hw2_image *reference = NULL;
+    ASSERT_EQ(0, hw2_image_load("./tests/images/desert.ppm", 1, &reference));
+    ASSERT_EQ(hw2_image_width(reference), hw2_image_width(image));
+    ASSERT_EQ(hw2_image_height(reference), hw2_image_height(image));
+
+    const hw2_format formats[] = {HW2_FORMAT_PPM_ASCII, HW2_FORMAT_PPM_BINARY, HW2_FORMAT_SBU, HW2_FORMAT_SBU_BINARY};
+    for (hw2_format format : formats) {
+        void *data = NULL;
+        size_t size = 0;
+        ASSERT_EQ(0, hw2_image_save_memory(image, format, &data, &size));
+        hw2_image *decoded = NULL;
+        ASSERT_EQ(0, hw2_image_load_memory(data, size, 1, &decoded));
+        free(data);
+        size_t rowBytes = (size_t) hw2_image_width(image) * 3;
+        for (int row = 0; row < hw2_image_height(image); row++) {
+            ASSERT_EQ(0, memcmp(hw2_image_row(reference, row), hw2_image_row(decoded, row), rowBytes)) << "row " << row;
+        }
+        hw2_image_free(decoded);
+    }
+    hw2_image_free(reference);
+    hw2_image_free(image);
+}
+
+// A zero-copy P6 image can be saved back over the file it was loaded from
+TEST_F(library_TestSuite, save_p6_over_source) {
+    const char *input_file = "./tests/images/seawolf.ppm";
+    const char *binary_output_file = "./tests/actual_outputs/result_p6.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    hw2_image *image = NULL;
+    ASSERT_EQ(0, hw2_image_load(input_file, 1, &image));
+    EXPECT_EQ(0, hw2_image_save(image, binary_output_file, HW2_FORMAT_PPM_BINARY));
+    hw2_image_free(image);
+    ASSERT_EQ(0, hw2_image_load(binary_output_file, 1, &image));
+    EXPECT_EQ(0, hw2_image_save(image, binary_output_file, HW2_FORMAT_PPM_BINARY));
+    EXPECT_EQ(0, hw2_image_save(image, actual_output_file, HW2_FORMAT_PPM_ASCII));
+    hw2_image_free(image);
+    check_image_file_contents(input_file, actual_output_file);
+    ASSERT_EQ(0, hw2_image_load(binary_output_file, 1, &image));
+    EXPECT_EQ(0, hw2_image_save(image, actual_output_file, HW2_FORMAT_PPM_ASCII));
+    hw2_image_free(image);
+    check_image_file_contents(input_file, actual_output_file);
+}
+
+// Failures come back as hw2.h error codes
+TEST_F(library_TestSuite, error_codes) {
+    hw2_image *image = NULL;
+    hw2_font *font = NULL;
+    EXPECT_EQ(INPUT_FILE_MISSING, hw2_image_load("./tests/images/missing.ppm", 1, &image));
+    EXPECT_EQ(INPUT_FILE_MISSING, hw2_image_load_memory("P3 oops", 7, 1, &image));
+    EXPECT_EQ(INPUT_FILE_MISSING, hw2_font_load("./tests/fonts/missing.txt", &font));
+    ASSERT_EQ(0, hw2_image_load("./tests/images/seawolf.ppm", 1, &image));
+    EXPECT_EQ(C_ARGUMENT_INVALID, hw2_copy_paste(image, -1, 0, 10, 10, 0, 0, 1));
+    EXPECT_EQ(P_ARGUMENT_INVALID, hw2_copy_paste(image, 0, 0, 10, 10, 0, -5, 1));
+    EXPECT_EQ(UNRECOGNIZED_ARGUMENT, hw2_image_save(image, "./tests/actual_outputs/result.txt", HW2_FORMAT_AUTO));
+    EXPECT_EQ(OUTPUT_FILE_UNWRITABLE, hw2_image_save(image, "./tests/missing/result.ppm", HW2_FORMAT_AUTO));
+    void *data = NULL;
+    size_t size = 0;
+    EXPECT_EQ(UNRECOGNIZED_ARGUMENT, hw2_image_save(image, "./tests/actual_outputs/result.ppm", (hw2_format) 42));
+    EXPECT_EQ(UNRECOGNIZED_ARGUMENT, hw2_image_save_memory(image, (hw2_format) -1, &data, &size));
+    EXPECT_EQ(UNRECOGNIZED_ARGUMENT, hw2_image_save_memory(image, HW2_FORMAT_AUTO, &data, &size));
+    EXPECT_EQ(NULL, hw2_image_row(image, hw2_image_height(image)));
+    hw2_image_free(image);
+}
+
+// A compiled font whose header or directory does not fit the file is rejected
+TEST_F(library_TestSuite, corrupt_compiled_font) {
+    const char *font_file = "./tests/actual_outputs/corrupt.hwf";
+    const uint32_t header[] = {0x46325748, 2, 1, 0x40000000};
+    const uint32_t entry[] = {'A', 0, 0, 0, 0, 0, 0, 0, 56, 0};
+    FILE *file = fopen(font_file, "wb");
+    ASSERT_NE(nullptr, file);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(entry, sizeof(entry), 1, file);
+    fclose(file);
+    hw2_font *font = NULL;
+    EXPECT_EQ(INPUT_FILE_MISSING, hw2_font_load(font_file, &font));
+    // A stored run that reaches past the glyph's ink box is rejected rather than trusted when drawing
+    const uint32_t runHeader[] = {0x46325748, 2, 1, 1};
+    const uint32_t runEntry[] = {'A', 4, 1, 0, 1, 0, 2, 0, 56, 0};
+    const int32_t block[] = {0, 1, 3, 2};
+    file = fopen(font_file, "wb");
+    ASSERT_NE(nullptr, file);
+    fwrite(runHeader, sizeof(runHeader), 1, file);
+    fwrite(runEntry, sizeof(runEntry), 1, file);
+    fwrite(block, sizeof(block), 1, file);
+    fclose(file);
+    EXPECT_EQ(INPUT_FILE_MISSING, hw2_font_load(font_file, &font));
+}
+
+// hw2_run takes the same command lines as hw2_main and can be called repeatedly
+TEST_F(library_TestSuite, run_command_line) {
+    char arg0[] = "hw2_main", i[] = "-i", input[] = "./tests/images/desert.ppm", o[] = "-o";
+    char output[] = "./tests/actual_outputs/result.ppm", c[] = "-c", copy[] = "90,10,50,100", p[] = "-p";
+    char paste[] = "90,60";
+    char *args[] = {arg0, i, input, o, output, c, copy, p, paste, NULL};
+    EXPECT_EQ(0, hw2_run(9, args));
+    check_image_file_contents("./tests/expected_outputs/cactus.ppm", output);
+    char *missingCopy[] = {arg0, i, input, o, output, p, paste, NULL};
+    EXPECT_EQ(C_ARGUMENT_MISSING, hw2_run(7, missingCopy));
+}
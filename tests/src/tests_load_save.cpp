@@ -64,3 +64,179 @@ TEST_F(image_operations_TestSuite, load_sbu_save_ppm) {
 	EXPECT_EQ(0, WEXITSTATUS(status));
     check_image_file_contents(expected_output_file, actual_output_file);
 }
+
+// Load a plain PPM with comments and a maxval other than 255
+TEST_F(image_operations_TestSuite, load_ppm_comments_maxval) {
+    const char *input_file = "./tests/images/comments_maxval15.ppm";
+    const char *expected_output_file = "./tests/expected_outputs/comments_maxval15.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Save a PPM image as binary P6, then load the P6 image and save it as P3
+TEST_F(image_operations_TestSuite, save_p6_load_p6) {
+    const char *input_file = "./tests/images/seawolf.ppm";
+    const char *binary_output_file = "./tests/actual_outputs/result_p6.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s --ppm-format P6", input_file, binary_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", binary_output_file, actual_output_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(input_file, actual_output_file);
+}
+
+// Load a binary P6 image and convert it to SBU
+TEST_F(image_operations_TestSuite, load_p6_save_sbu) {
+    const char *input_file = "./tests/images/seawolf.ppm";
+    const char *binary_output_file = "./tests/actual_outputs/result_p6.ppm";
+    const char *expected_output_file = "./tests/images/seawolf.sbu";
+    const char *actual_output_file = "./tests/actual_outputs/result.sbu";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s --ppm-format P6", input_file, binary_output_file);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", binary_output_file, actual_output_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Save a PPM image as binary SBU, then load the binary SBU image and save it as PPM
+TEST_F(image_operations_TestSuite, save_binary_sbu_load_binary_sbu) {
+    const char *input_file = "./tests/images/stony.ppm";
+    const char *binary_output_file = "./tests/actual_outputs/result_binary.sbu";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s --sbu-format binary", input_file, binary_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", binary_output_file, actual_output_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(input_file, actual_output_file);
+}
+
+// Convert a binary SBU image back to text SBU
+TEST_F(image_operations_TestSuite, load_binary_sbu_save_sbu) {
+    const char *input_file = "./tests/images/seawolf.sbu";
+    const char *binary_output_file = "./tests/actual_outputs/result_binary.sbu";
+    const char *actual_output_file = "./tests/actual_outputs/result.sbu";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s --sbu-format binary", input_file, binary_output_file);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", binary_output_file, actual_output_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(input_file, actual_output_file);
+}
+
+// Load a PPM image with the multi-threaded P3 parser and copy it to PPM
+TEST_F(image_operations_TestSuite, load_ppm_threads_save_ppm) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *expected_output_file = "./tests/images/desert.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s --threads 4", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Pipe an image through stdin and stdout, converting it to SBU and back on the way
+TEST_F(image_operations_TestSuite, load_stdin_save_stdout) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *expected_output_file = "./tests/images/desert.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i - -o - --format sbu < %s | ./build/hw2_main -i - -o %s", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// A P6 image redirected from the output file itself is rewritten in place, and refused when streaming
+TEST_F(image_operations_TestSuite, load_stdin_save_same_p6) {
+    const char *input_file = "./tests/images/seawolf.ppm";
+    const char *binary_output_file = "./tests/actual_outputs/result_p6.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s --ppm-format P6", input_file, binary_output_file);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i - -o %s --ppm-format P6 < %s", binary_output_file, binary_output_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i - -o %s --ppm-format P6 --max-memory 64K < %s", binary_output_file, binary_output_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(OUTPUT_FILE_UNWRITABLE, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", binary_output_file, actual_output_file);
+	status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(input_file, actual_output_file);
+}
+
+// A bad body is an input error with or without --max-memory, and leaves no output behind
+TEST_F(image_operations_TestSuite, load_bad_sbu_index) {
+    const char *input_file = "./tests/actual_outputs/bad_index.sbu";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "printf 'SBU\\n2 2\\n1 0 0 0\\n0 0 0 5\\n' > %s", input_file);
+    system(cmd);
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(INPUT_FILE_MISSING, WEXITSTATUS(status));
+    EXPECT_FALSE(file_exists(actual_output_file));
+    sprintf(cmd, "./build/hw2_main -i %s -o %s --max-memory 2M", input_file, actual_output_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(INPUT_FILE_MISSING, WEXITSTATUS(status));
+    EXPECT_FALSE(file_exists(actual_output_file));
+}
+
+// A failed write is an output error with or without --max-memory
+TEST_F(image_operations_TestSuite, save_stdout_full) {
+    const char *input_file = "./tests/images/desert.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o - --format ppm > /dev/full", input_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(OUTPUT_FILE_UNWRITABLE, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i %s -o - --format ppm --max-memory 2M > /dev/full", input_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(OUTPUT_FILE_UNWRITABLE, WEXITSTATUS(status));
+}
+
+// A --max-memory budget must hold the 1 MiB output buffer and at least one row
+TEST_F(image_operations_TestSuite, streaming_budget_too_small) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s --max-memory 64K", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(UNRECOGNIZED_ARGUMENT, WEXITSTATUS(status));
+    EXPECT_FALSE(file_exists(actual_output_file));
+}
+
+// The input format comes from the file's magic bytes, not its extension
+TEST_F(image_operations_TestSuite, load_sbu_named_ppm) {
+    const char *input_file = "./tests/actual_outputs/desert_sbu.ppm";
+    const char *expected_output_file = "./tests/images/desert.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    system("cp ./tests/images/desert.sbu ./tests/actual_outputs/desert_sbu.ppm");
+    sprintf(cmd, "./build/hw2_main -i %s -o %s", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
@@ -159,4 +159,58 @@ TEST_F(image_operations_TestSuite, print_overflow_message4_2) {
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
     check_image_file_contents(expected_output_file, actual_output_file);
-}
\ No newline at end of file
+}
+
+// Print a message with a font compiled by --compile-font
+TEST_F(image_operations_TestSuite, print_compiled_font) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *font_file = "./tests/actual_outputs/font1.hwf";
+    const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message3_1.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main --compile-font ./tests/fonts/font1.txt -o %s", font_file);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"new YORK state\",\"%s\",2,40,180", input_file, actual_output_file, font_file);
+    INFO(cmd);
+    status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Print digits and punctuation with a font whose glyphs are named by a #!keys line
+TEST_F(image_operations_TestSuite, print_keyed_font) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *expected_output_file = "./tests/expected_outputs/desert_digits_message.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"12:30-45! 6.7?89\",\"./tests/fonts/font5.txt\",3,20,10", input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// A pen column or font size near INT_MAX drops the glyphs instead of wrapping back into the image
+TEST_F(image_operations_TestSuite, print_huge_column_and_size) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"AB AB\",\"./tests/fonts/font1.txt\",1,1,2147483640", input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(input_file, actual_output_file);
+    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"AB AB\",\"./tests/fonts/font1.txt\",2147483647,1,1", input_file, actual_output_file);
+    INFO(cmd);
+    status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(input_file, actual_output_file);
+}
+
+// A message with characters the font lacks is rejected
+TEST_F(image_operations_TestSuite, print_unsupported_characters) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
+    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"12 am\",\"./tests/fonts/font5.txt\",3,20,10", input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
+}
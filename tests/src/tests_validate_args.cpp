@@ -184,4 +184,10 @@ TEST_F(validate_args_TestSuite, missing_parameter09) {
 TEST_F(validate_args_TestSuite, missing_parameter10) {
 	int status = run_using_system("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/fonts200.txt\",10,15 -o ./tests/actual_outputs/result1.ppm");
 	EXPECT_EQ(C_ARGUMENT_MISSING, WEXITSTATUS(status));
-}
\ No newline at end of file
+}
+
+// Writing to stdout has no extension to go by, so --format is required
+TEST_F(validate_args_TestSuite, stdout_without_format) {
+	int status = run_using_system("-i ./tests/images/seawolf.ppm -o -");
+	EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
+}